@@ -0,0 +1,394 @@
+#pragma once
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <utility>
+
+#include "room.hpp"
+#include "ray.hpp"
+#include "raycaster.hpp"
+#include "raypacket.hpp"
+#include "raycache.hpp"
+#include "transpose.hpp"
+#include "texture.hpp"
+
+// Headless timings for the ray stage, run with: ./dungeon --bench
+// Does not open a window so it can be run over ssh on the target machines.
+class Benchmark {
+    public:
+        static void run() {
+            std::cout << "-- Ray stage --\n";
+            benchmarkRayKernels(800);
+            benchmarkRayKernels(1920);
+            std::cout << "-- Open areas --\n";
+            for (int size = 64; size <= 4096; size *= 4) {
+                benchmarkOpenArea(size);
+            }
+            std::cout << "-- Framebuffer --\n";
+            benchmarkFramebuffer(800, 600);
+            benchmarkFramebuffer(1920, 1080);
+            std::cout << "-- Textured walls --\n";
+            benchmarkTexturedWalls(800, 600, 256);
+            benchmarkTexturedWalls(1920, 1080, 256);
+            benchmarkTexturedWalls(1920, 1080, 1024);  // bigger than L2 on most machines
+        }
+
+        static inline const int cellSize = 50;  // matches Room::wallSize
+
+        struct Pose {
+            Point2D origin;
+            double rotRad;
+            std::pair<Point2D, Point2D> cameraPlane;
+        };
+
+        // camera plane laid out the same way as Player::setupCamera
+        static Pose makePose(const Point2D& origin, double rotRad) {
+            Pose pose;
+            pose.origin = origin;
+            pose.rotRad = rotRad;
+            Point2D left(origin.x() + 15, origin.y() + 20);
+            Point2D right(origin.x() - 15, origin.y() + 20);
+            pose.cameraPlane.first = left.rotateRad(origin, rotRad);
+            pose.cameraPlane.second = right.rotateRad(origin, rotRad);
+            return pose;
+        }
+
+        // random poses stood in empty cells of a room
+        static std::vector<Pose> makePoses(const GridView& grid, Random& random, int count) {
+            std::vector<Pose> poses;
+            while ((int) poses.size() < count) {
+                int x = random.between(1, grid.width - 1);
+                int y = random.between(1, grid.height - 1);
+                if (GridView::solidCell(grid.at(x, y))) {
+                    continue;
+                }
+                Point2D origin(x * cellSize + random.between(1, cellSize), y * cellSize + random.between(1, cellSize));
+                poses.push_back(makePose(origin, random.random(3600) * M_PI / 1800));
+            }
+            return poses;
+        }
+
+        static double secondsSince(std::chrono::steady_clock::time_point start) {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+    private:
+        static inline const int roomCount = 20;
+        static inline const int posesPerRoom = 50;
+
+        static void report(const char* name, int columns, long rays, double seconds, double baseline, long steps = -1) {
+            std::cout << "  " << name << ": " << (long) (rays / seconds) << " rays/s, "
+                      << seconds * 1000 / (rays / columns) << " ms/frame";
+            if (baseline > 0) {
+                std::cout << ", " << baseline / seconds << "x";
+            }
+            if (steps >= 0) {
+                std::cout << ", " << (double) steps / rays << " steps/ray";
+            }
+            std::cout << '\n';
+        }
+
+        static void benchmarkRayKernels(int columns) {
+            Random random;
+            std::vector<Room*> rooms;
+            std::vector<std::vector<Pose>> poses;
+            for (int i = 0; i < roomCount; i++) {
+                rooms.push_back(new Room(20, 20));
+                poses.push_back(makePoses(rooms[i]->getMap(), random, posesPerRoom));
+            }
+            long rays = (long) roomCount * posesPerRoom * columns;
+            int checksum = 0;  // stops the compiler discarding unused casts
+            RayBatch batch;
+            ColumnTable table;
+
+            std::cout << columns << " columns\n";
+
+            // -- Ray2D per column, as draw3D used to --
+            auto start = std::chrono::steady_clock::now();
+            for (int r = 0; r < roomCount; r++) {
+                GridView grid = rooms[r]->getMap();
+                double maxDistance = rooms[r]->getMaxDistance();
+                for (Pose& pose : poses[r]) {
+                    Point2D castPoint(pose.cameraPlane.first);
+                    Point2D offset((pose.cameraPlane.second.x() - pose.cameraPlane.first.x()) / columns,
+                                   (pose.cameraPlane.second.y() - pose.cameraPlane.first.y()) / columns);
+                    for (int x = 0; x < columns; x++) {
+                        Ray2D ray(pose.origin, pose.origin.getAngleTo(castPoint), (int) ceil(maxDistance / cellSize) + 1, cellSize, grid);
+                        checksum += ray.getHit();
+                        castPoint = castPoint + offset;
+                    }
+                }
+            }
+            double referenceSeconds = secondsSince(start);
+            report("Ray2D", columns, rays, referenceSeconds, 0);
+
+            // -- each kernel a ray at a time --
+            for (int kernel = RayKernel::referenceKernel; kernel <= RayKernel::fixedKernel; kernel++) {
+                long steps = 0;
+                start = std::chrono::steady_clock::now();
+                for (int r = 0; r < roomCount; r++) {
+                    GridView grid = rooms[r]->getMap();
+                    double maxDistance = rooms[r]->getMaxDistance();
+                    for (Pose& pose : poses[r]) {
+                        RayCaster::castRays(grid, pose.origin, pose.cameraPlane, columns, cellSize, maxDistance, table, batch, (RayKernel) kernel);
+                        checksum += batch.hit[0];
+                        steps += batch.totalSteps;
+                    }
+                }
+                std::string name = std::string("castRays ") + RayCaster::getKernelName((RayKernel) kernel);
+                report(name.c_str(), columns, rays, secondsSince(start), referenceSeconds, steps);
+            }
+
+            // -- plain DDA built for each arithmetic type --
+            report("castPlain float", columns, rays, timePlain<float>(rooms, poses, columns, table, checksum), referenceSeconds);
+            report("castPlain double", columns, rays, timePlain<double>(rooms, poses, columns, table, checksum), referenceSeconds);
+            report("castPlain fixed", columns, rays, timePlain<fixed>(rooms, poses, columns, table, checksum), referenceSeconds);
+
+            // -- line of sight from each pose to every other pose in the room --
+            long checks = 0;
+            start = std::chrono::steady_clock::now();
+            for (int r = 0; r < roomCount; r++) {
+                GridView grid = rooms[r]->getMap();
+                for (Pose& from : poses[r]) {
+                    for (Pose& to : poses[r]) {
+                        checksum += RayCaster::lineOfSight(grid, from.origin, to.origin, cellSize);
+                        checks++;
+                    }
+                }
+            }
+            std::cout << "  lineOfSight: " << (long) (checks / secondsSince(start)) << " checks/s\n";
+
+            // -- packets --
+            PacketMode supported = RayPacket::getSupportedMode();
+            for (int mode = PacketMode::scalarPacket; mode <= supported; mode++) {
+                RayPacket::setMode((PacketMode) mode);
+                start = std::chrono::steady_clock::now();
+                for (int r = 0; r < roomCount; r++) {
+                    GridView grid = rooms[r]->getMap();
+                    double maxDistance = rooms[r]->getMaxDistance();
+                    for (Pose& pose : poses[r]) {
+                        RayPacket::castRays(grid, pose.origin, pose.cameraPlane, columns, cellSize, maxDistance, table, batch);
+                        checksum += batch.hit[0];
+                    }
+                }
+                std::string name = std::string("RayPacket ") + RayPacket::getModeName((PacketMode) mode);
+                report(name.c_str(), columns, rays, secondsSince(start), referenceSeconds);
+            }
+            RayPacket::setMode(supported);
+
+            // -- same pose every frame, as when the player stands still --
+            RayCache cache;
+            start = std::chrono::steady_clock::now();
+            for (int r = 0; r < roomCount; r++) {
+                GridView grid = rooms[r]->getMap();
+                double maxDistance = rooms[r]->getMaxDistance();
+                Pose& pose = poses[r][0];
+                for (int frame = 0; frame < posesPerRoom; frame++) {
+                    RayPose key(grid, pose.origin, 0, pose.cameraPlane, columns, cellSize, maxDistance, RayKernel::blockKernel);
+                    if (!cache.lookup(key)) {
+                        RayPacket::castRays(grid, pose.origin, pose.cameraPlane, columns, cellSize, maxDistance, table, batch);
+                        cache.store(key);
+                    }
+                    checksum += batch.hit[0];
+                }
+            }
+            report("RayCache static pose", columns, rays, secondsSince(start), referenceSeconds);
+
+            // -- turning on the spot at the player's turn speed --
+            RayBatch previous;
+            long recast = 0;
+            double turnSeconds = 0;
+            for (int r = 0; r < roomCount; r++) {
+                GridView grid = rooms[r]->getMap();
+                double maxDistance = rooms[r]->getMaxDistance();
+                for (Pose& pose : poses[r]) {
+                    Pose turned = makePose(pose.origin, pose.rotRad + 0.1);
+                    RayCaster::castRays(grid, pose.origin, pose.cameraPlane, columns, cellSize, maxDistance, table, previous);
+                    start = std::chrono::steady_clock::now();
+                    recast += RayCaster::reprojectRays(grid, pose.origin, turned.cameraPlane, pose.cameraPlane, previous, columns, cellSize, maxDistance, table, batch);
+                    turnSeconds += secondsSince(start);
+                    checksum += batch.hit[0];
+                }
+            }
+            report("reprojectRays 0.1 rad turn", columns, rays, turnSeconds, referenceSeconds);
+            std::cout << "    " << 100.0 * recast / rays << "% of columns recast\n";
+
+            for (Room* room : rooms) {
+                delete room;
+            }
+            if (checksum == -1) {
+                std::cout << '\n';
+            }
+        }
+
+        // seconds to cast every pose's columns one at a time with castPlain<Scalar>
+        template <typename Scalar>
+        static double timePlain(std::vector<Room*>& rooms, std::vector<std::vector<Pose>>& poses, int columns, ColumnTable& table,
+                                int& checksum) {
+            auto start = std::chrono::steady_clock::now();
+            for (int r = 0; r < roomCount; r++) {
+                GridView grid = rooms[r]->getMap();
+                double maxDistance = rooms[r]->getMaxDistance();
+                for (Pose& pose : poses[r]) {
+                    table.update(pose.origin, pose.cameraPlane, columns);
+                    for (int i = 0; i < columns; i++) {
+                        double dirX, dirY;
+                        table.direction(i, dirX, dirY);
+                        checksum += RayCaster::castPlain<Scalar>(grid, pose.origin, dirX, dirY, cellSize, maxDistance).hit;
+                    }
+                }
+            }
+            return secondsSince(start);
+        }
+
+        // Frames of one wall span per column, drawn the way Window::fillColumn does, into a
+        // row-major buffer and into a column-major one that is transposed for upload.
+        static void benchmarkFramebuffer(int width, int height) {
+            const int frames = 200;
+            Random random;
+            std::vector<uint32_t> rows(width * height);
+            std::vector<uint32_t> columns(width * height);
+            std::vector<int> heights(width * frames);
+            for (int& h : heights) {
+                h = random.between(1, height + 1);
+            }
+
+            std::cout << width << "x" << height << ":\n";
+            auto start = std::chrono::steady_clock::now();
+            for (int frame = 0; frame < frames; frame++) {
+                std::fill(rows.begin(), rows.end(), 0);
+                for (int x = 0; x < width; x++) {
+                    int h = heights[frame * width + x];
+                    uint32_t* pixel = &rows[(height - h) / 2 * width + x];
+                    for (int y = 0; y < h; y++) {
+                        *pixel = 0xFF808080;
+                        pixel += width;
+                    }
+                }
+            }
+            double rowSeconds = secondsSince(start);
+            std::cout << "  row major: " << rowSeconds * 1000 / frames << " ms/frame\n";
+
+            TransposeMode supported = Transpose::getSupportedMode();
+            for (int mode = TransposeMode::naiveTranspose; mode <= supported; mode++) {
+                Transpose::setMode((TransposeMode) mode);
+                double drawSeconds = 0;
+                start = std::chrono::steady_clock::now();
+                for (int frame = 0; frame < frames; frame++) {
+                    auto drawStart = std::chrono::steady_clock::now();
+                    std::fill(columns.begin(), columns.end(), 0);
+                    for (int x = 0; x < width; x++) {
+                        int h = heights[frame * width + x];
+                        uint32_t* pixel = &columns[x * height + (height - h) / 2];
+                        for (int y = 0; y < h; y++) {
+                            *pixel++ = 0xFF808080;
+                        }
+                    }
+                    drawSeconds += secondsSince(drawStart);
+                    Transpose::columnsToRows(columns.data(), rows.data(), width, height);
+                }
+                double seconds = secondsSince(start);
+                std::cout << "  column major + " << Transpose::getModeName((TransposeMode) mode) << " transpose: "
+                          << seconds * 1000 / frames << " ms/frame (" << drawSeconds * 1000 / frames << " drawing), "
+                          << rowSeconds / seconds << "x\n";
+            }
+            Transpose::setMode(supported);
+        }
+
+        // Frames of textured wall slices into a column-major buffer, sampled the way
+        // Room::drawTexturedWall does from the mip level for each slice's height and from the
+        // full size texture every time. Walls are spread evenly over 1 to 20 cells away, so
+        // most slices are small and the full size texture is read with big strides.
+        static void benchmarkTexturedWalls(int width, int height, int textureSize) {
+            const int frames = 100;
+            Random random;
+            std::vector<Uint32> image(textureSize * textureSize);
+            for (Uint32& texel : image) {
+                texel = (Uint32) rand();
+            }
+            MipTexture texture(image.data(), textureSize, textureSize, textureSize);
+            std::vector<uint32_t> columns(width * height);
+            std::vector<int> heights(width * frames);
+            for (int& h : heights) {
+                h = (int) (height / (1 + random.random(1900) / 100.0));
+            }
+
+            std::cout << width << "x" << height << ", " << textureSize << "x" << textureSize << " texture, "
+                      << texture.getLevelCount() << " levels:\n";
+            double fullSizeSeconds = 0;
+            for (int mipmapped = 0; mipmapped <= 1; mipmapped++) {
+                auto start = std::chrono::steady_clock::now();
+                for (int frame = 0; frame < frames; frame++) {
+                    for (int x = 0; x < width; x++) {
+                        int h = heights[frame * width + x];
+                        int level = mipmapped ? texture.levelFor(h) : 0;
+                        const Uint32* texels = texture.column(level, x % texture.getWidth(level));
+                        int32_t vStep = (int32_t) (((int64_t) texture.getHeight(level) << 16) / h);
+                        int32_t v = 0;
+                        uint32_t* pixel = &columns[x * height + (height - h) / 2];
+                        for (int y = 0; y < h; y++) {
+                            *pixel++ = texels[v >> 16];
+                            v += vStep;
+                        }
+                    }
+                }
+                double seconds = secondsSince(start);
+                if (!mipmapped) {
+                    fullSizeSeconds = seconds;
+                }
+                std::cout << "  " << (mipmapped ? "mipmapped" : "full size") << ": " << seconds * 1000 / frames << " ms/frame"
+                          << (mipmapped ? ", " + std::to_string(fullSizeSeconds / seconds) + "x" : "") << '\n';
+            }
+        }
+
+        // Empty square map with walls round the edge and a budget reaching its far corner. Grid stepping cost grows
+        // with the size of the map, the block kernel's steps with its log. The distance field kernel stays flat until
+        // open space is wider than GridView::maxDistance.
+        static void benchmarkOpenArea(int size) {
+            const int rays = 20000;
+            Random random;
+            Grid grid(size, size, EMPTY);
+            for (int i = 0; i < size; i++) {
+                grid.set(i, 0, WALL);
+                grid.set(i, size - 1, WALL);
+                grid.set(0, i, WALL);
+                grid.set(size - 1, i, WALL);
+            }
+            GridView view = grid.view();
+            double maxDistance = RayCaster::distanceBudget(view, cellSize);
+
+            std::vector<Point2D> origins;
+            std::vector<double> angles;
+            for (int i = 0; i < rays; i++) {
+                origins.push_back(Point2D(random.between(cellSize, (size - 1) * cellSize) + 0.5, random.between(cellSize, (size - 1) * cellSize) + 0.5));
+                angles.push_back(random.random(3600) * M_PI / 1800);
+            }
+
+            int checksum = 0;
+            std::cout << size << "x" << size << ":";
+            for (int kernel = RayKernel::blockKernel; kernel <= RayKernel::fixedKernel; kernel++) {
+                long steps = 0;
+                auto start = std::chrono::steady_clock::now();
+                for (int i = 0; i < rays; i++) {
+                    RayHit ray = RayCaster::cast((RayKernel) kernel, view, origins[i], sin(angles[i]), cos(angles[i]), cellSize, maxDistance);
+                    steps += ray.steps;
+                    checksum += ray.hit;
+                }
+                std::cout << " " << RayCaster::getKernelName((RayKernel) kernel) << " " << secondsSince(start) * 1e9 / rays
+                          << " ns/ray " << (double) steps / rays << " steps/ray,";
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < rays; i++) {
+                Ray2D ray(origins[i], angles[i], size, cellSize, view);  // size grid lines reach any wall
+                checksum += ray.getHit();
+            }
+            double referenceSeconds = secondsSince(start);
+
+            std::cout << " Ray2D " << referenceSeconds * 1e9 / rays << " ns/ray\n";
+            if (checksum == -1) {
+                std::cout << '\n';
+            }
+        }
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <math.h>
+#include "point.hpp"
+
+// Direction of every screen column in camera space, where a column's direction is some
+// amount across the camera plane plus some amount along the view axis. These only depend
+// on the number of columns and the shape of the camera plane (the field of view) so are
+// built once and only turned to face the player's heading each frame.
+// Assumes the camera plane is square on to the view axis, as Player::setupCamera lays it out.
+class ColumnTable {
+    public:
+        int rebuilds = 0;
+
+        // rebuilds the tables if the resolution or field of view changed, then turns them
+        // to match cameraPlane
+        void update(const Point2D& origin, const std::pair<Point2D, Point2D>& cameraPlane, int columnCount) {
+            // view axis runs from the origin through the middle of the camera plane
+            forwardX = (cameraPlane.first.x() + cameraPlane.second.x()) / 2 - origin.x();
+            forwardY = (cameraPlane.first.y() + cameraPlane.second.y()) / 2 - origin.y();
+            lateralX = cameraPlane.second.x() - cameraPlane.first.x();
+            lateralY = cameraPlane.second.y() - cameraPlane.first.y();
+            double distance = sqrt(forwardX * forwardX + forwardY * forwardY);
+            double width = sqrt(lateralX * lateralX + lateralY * lateralY);
+            forwardX /= distance;
+            forwardY /= distance;
+            lateralX /= width;
+            lateralY /= width;
+
+            // turning the plane moves its ends by rounding errors, which shouldn't count as a change
+            if (columnCount != this->columnCount || fabs(distance - planeDistance) > distance * 1e-9
+                || fabs(width - planeWidth) > width * 1e-9) {
+                build(distance, width, columnCount);
+            }
+        }
+
+        int getColumnCount() const {
+            return columnCount;
+        }
+
+        // unit direction of a column in world space
+        void direction(int column, double& dirX, double& dirY) const {
+            dirX = across[column] * lateralX + along[column] * forwardX;
+            dirY = across[column] * lateralY + along[column] * forwardY;
+        }
+
+        // cos of the angle between a column and the view axis, turns euclidean distances
+        // into distances along the view axis
+        double correction(int column) const {
+            return along[column];
+        }
+
+        // Direction of a column scaled so its component along the view axis is one. Distances
+        // along it come out already perpendicular to the camera plane.
+        void viewDirection(int column, double& dirX, double& dirY) const {
+            dirX = forwardX + tangent[column] * lateralX;
+            dirY = forwardY + tangent[column] * lateralY;
+        }
+
+        // length of a view direction, turns perpendicular distances back into euclidean ones
+        double viewLength(int column) const {
+            return secant[column];
+        }
+
+        // Inverse of viewDirection, for a point offset (dx, dy) from the origin: its distance along
+        // the view axis and the column it's seen through, fractional and off screen when outside
+        // [0, columnCount). Only meaningful for points in front, where depth is positive.
+        void project(double dx, double dy, double& depth, double& column) const {
+            depth = dx * forwardX + dy * forwardY;
+            double across = dx * lateralX + dy * lateralY;
+            column = (across / depth * planeDistance / planeWidth + 0.5) * columnCount;
+        }
+
+        // columns something one unit wide covers at a depth of one unit
+        double columnsPerUnit() const {
+            return columnCount * planeDistance / planeWidth;
+        }
+
+    private:
+        int columnCount = 0;
+        double planeDistance = 0;
+        double planeWidth = 0;
+        std::vector<double> across;
+        std::vector<double> along;
+        std::vector<double> tangent;  // across / along
+        std::vector<double> secant;  // 1 / along
+        // this frame's camera space axes in world space
+        double forwardX = 0, forwardY = 1;
+        double lateralX = 1, lateralY = 0;
+
+        // columns go through evenly spaced points from the left end of the plane
+        void build(double distance, double width, int columnCount) {
+            this->columnCount = columnCount;
+            planeDistance = distance;
+            planeWidth = width;
+            across.resize(columnCount);
+            along.resize(columnCount);
+            tangent.resize(columnCount);
+            secant.resize(columnCount);
+            for (int i = 0; i < columnCount; i++) {
+                double x = width * ((double) i / columnCount - 0.5);
+                double length = sqrt(x * x + distance * distance);
+                across[i] = x / length;
+                along[i] = distance / length;
+                tangent[i] = x / distance;
+                secant[i] = length / distance;
+            }
+            rebuilds++;
+        }
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+
+// 16.16 fixed point number
+typedef int32_t fixed;
+
+// Helpers for the fixed point render path. Once values are converted in, only integer
+// arithmetic is used, so results come out the same bit for bit on any compiler or CPU.
+class Fixed {
+    public:
+        static inline const int fractionBits = 16;
+        static inline const fixed one = 1 << fractionBits;
+        static inline const fixed fractionMask = one - 1;
+        static inline const fixed infinity = 0x3FFFFFFF;  // leaves headroom so adding two never overflows
+
+        // conversions are for the edges of the fixed point path, not inside its loops
+        static fixed fromDouble(double d) {
+            return (fixed) lround(d * one);
+        }
+
+        static double toDouble(fixed f) {
+            return f * (1.0 / one);
+        }
+
+        static fixed fromInt(int i) {
+            return i * one;
+        }
+
+        // rounds towards negative infinity like floor
+        static int toInt(fixed f) {
+            return f >> fractionBits;
+        }
+
+        static fixed mul(fixed a, fixed b) {
+            return (fixed) (((int64_t) a * b) >> fractionBits);
+        }
+
+        // 1 / f from a table, f must be positive. Saturates at infinity for tiny values.
+        // f is split into m * 2^p with m in [1, 2), 1 / m is interpolated from the table and
+        // shifted back, giving close to full 16.16 precision without a divide.
+        static fixed reciprocal(fixed f) {
+            if (f <= 0) {
+                return infinity;
+            }
+            int p = 31 - __builtin_clz((uint32_t) f);
+            uint32_t mantissa = ((uint32_t) f << (30 - p)) - (1u << 30);  // fraction of m, 30 bits
+            int index = mantissa >> (30 - tableBits);
+            int64_t remainder = mantissa & ((1 << (30 - tableBits)) - 1);
+            int64_t inverse = reciprocalTable.entries[index] - (((reciprocalTable.entries[index] - reciprocalTable.entries[index + 1]) * remainder) >> (30 - tableBits));
+
+            // inverse is 2^30 / m, the result is 2^(32 - p) / m
+            int64_t result = (p <= 2) ? inverse << (2 - p) : (inverse + (1LL << (p - 3))) >> (p - 2);
+            return (result > infinity) ? infinity : (fixed) result;
+        }
+
+    private:
+        static inline const int tableBits = 12;
+
+        // Integer division only, so the table is identical everywhere. Built before main
+        // rather than on first use so render threads can share it without a check.
+        struct ReciprocalTable {
+            int32_t entries[(1 << tableBits) + 1];  // 2^30 / m for m in [1, 2]
+
+            ReciprocalTable() {
+                const int64_t size = 1 << tableBits;
+                for (int64_t i = 0; i <= size; i++) {
+                    entries[i] = (int32_t) (((1LL << 30) * size + (size + i) / 2) / (size + i));
+                }
+            }
+        };
+        static inline const ReciprocalTable reciprocalTable;
+};
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+#include "window.hpp"
+#include "texture.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FLOORCASTER_X86
+#include <immintrin.h>
+#endif
+
+// Instruction set used to fill floor and ceiling rows
+enum FloorMode {
+    scalarFloor,  // a pixel at a time
+    avx2Floor  // 8 floor and 8 ceiling pixels per step
+};
+
+// Everything the rows of a frame share, filled in once before they're drawn
+struct FloorFrame {
+    double originX, originY;  // camera in cells
+    double leftX, leftY;  // view direction of the leftmost column, its component along the view axis is one
+    double stepX, stepY;  // change in view direction from one column to the next
+    int width, height;  // screen
+    const int* ceilingEnds;  // per column, rows above this are ceiling
+    const int* floorStarts;  // per column, rows from this down are floor
+    const int* floorShades;  // per floor row from the horizon down, out of 256
+    const int* ceilingShades;  // per ceiling row from the horizon up
+    const FlatTexture* texture;  // tiled once per cell
+};
+
+// Draws floors and ceilings a row of the screen at a time. Every pixel in a row of floor is
+// the same distance away along the view axis, and view directions step evenly across the
+// screen, so the texture coordinates do too: one divide a row then adds across it.
+// The ceiling row the same distance above the horizon shares the coordinates, so each step
+// fills both. Pixels covered by walls are masked off so nothing is drawn twice.
+// Rows are contiguous only in a row-major framebuffer, column-major ones use the scalar kernel.
+// Like RayPacket the widest mode the CPU supports is picked at runtime.
+class FloorCaster {
+    public:
+        static const FloorMode getMode() {
+            if (!modeChosen) {
+                setMode(getSupportedMode());
+            }
+            return mode;
+        }
+
+        // requested mode is lowered to the best the CPU supports
+        static void setMode(FloorMode requested) {
+            FloorMode supported = getSupportedMode();
+            mode = (requested > supported) ? supported : requested;
+            modeChosen = true;
+        }
+
+        static const char* getModeName(FloorMode floorMode) {
+            return (floorMode == FloorMode::avx2Floor) ? "avx2" : "scalar";
+        }
+
+        static const FloorMode getSupportedMode() {
+#ifdef FLOORCASTER_X86
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2")) {
+                return FloorMode::avx2Floor;
+            }
+#endif
+            return FloorMode::scalarFloor;
+        }
+
+        // Rows from the horizon to the middle of floor row, counted down from the horizon.
+        // With an odd height the first row straddles the horizon, so it's kept half a row down
+        // like the first row of an even height rather than being infinitely far away.
+        static double rowOffset(int row, int height) {
+            return std::max(height / 2 + row + 0.5 - height / 2.0, 0.5);
+        }
+
+        // Draws floor rows [begin, end) counted down from the horizon, and the ceiling rows
+        // mirroring them. Rows don't share anything they write so can be split between threads,
+        // call getMode first.
+        static void drawRows(Window& window, const FloorFrame& frame, int begin, int end) {
+            bool wide = getMode() == FloorMode::avx2Floor && window.rowStep() == 1;
+            int horizon = frame.height / 2;
+            for (int row = begin; row < end; row++) {
+                int floorY = horizon + row;
+                int ceilingY = frame.height - 1 - floorY;
+
+                // distance in cells along the view axis, a wall this far away would reach this row
+                double distance = frame.height / (2 * rowOffset(row, frame.height));
+                int level = frame.texture->levelFor(distance * hypot(frame.stepX, frame.stepY) * (1 << frame.texture->getSizeBits(0)));
+                int sizeBits = frame.texture->getSizeBits(level);
+                // 16.16 texels, unsigned so they wrap round the texture rather than overflow
+                double scale = (double) (1 << sizeBits) * 65536;
+                Span span;
+                span.texels = frame.texture->getTexels(level);
+                span.sizeBits = sizeBits;
+                span.u = (uint32_t) (int64_t) floor((frame.originX + distance * frame.leftX) * scale);
+                span.v = (uint32_t) (int64_t) floor((frame.originY + distance * frame.leftY) * scale);
+                span.du = (uint32_t) (int64_t) llround(distance * frame.stepX * scale);
+                span.dv = (uint32_t) (int64_t) llround(distance * frame.stepY * scale);
+                span.floorY = floorY;
+                span.ceilingY = ceilingY;
+                span.floorShade = frame.floorShades[row];
+                span.ceilingShade = frame.ceilingShades[row];
+
+                int x = 0;
+#ifdef FLOORCASTER_X86
+                if (wide) {
+                    x = drawSpanAVX2(window.rowStart(floorY), window.rowStart(ceilingY), frame, span);
+                }
+#endif
+                drawSpanScalar(window.rowStart(floorY), window.rowStart(ceilingY), window.rowStep(), frame, span, x);
+            }
+        }
+
+    private:
+        static inline FloorMode mode = FloorMode::scalarFloor;
+        static inline bool modeChosen = false;
+
+        // one floor row and its ceiling row
+        struct Span {
+            const Uint32* texels;
+            int sizeBits;
+            uint32_t u, v, du, dv;  // at the left edge of the screen
+            int floorY, ceilingY;
+            int floorShade, ceilingShade;
+        };
+
+        // columns [start, width) a pixel at a time
+        static void drawSpanScalar(Uint32* floorRow, Uint32* ceilingRow, int step, const FloorFrame& frame, const Span& span, int start) {
+            uint32_t mask = (1u << span.sizeBits) - 1;
+            uint32_t u = span.u + span.du * start;
+            uint32_t v = span.v + span.dv * start;
+            for (int x = start; x < frame.width; x++) {
+                bool floor = frame.floorStarts[x] <= span.floorY;
+                bool ceiling = frame.ceilingEnds[x] > span.ceilingY;
+                if (floor || ceiling) {
+                    Uint32 texel = span.texels[(((v >> 16) & mask) << span.sizeBits) | ((u >> 16) & mask)];
+                    if (floor) {
+                        floorRow[x * step] = Window::shadeTexel(texel, span.floorShade);
+                    }
+                    if (ceiling) {
+                        ceilingRow[x * step] = Window::shadeTexel(texel, span.ceilingShade);
+                    }
+                }
+                u += span.du;
+                v += span.dv;
+            }
+        }
+
+#ifdef FLOORCASTER_X86
+        __attribute__((target("avx2")))
+        static inline __m256i shadeTexels(__m256i texels, __m256i shade) {
+            __m256i redBlue = _mm256_and_si256(_mm256_srli_epi32(_mm256_mullo_epi32(_mm256_and_si256(texels, _mm256_set1_epi32(0xFF00FF)), shade), 8),
+                                               _mm256_set1_epi32(0xFF00FF));
+            __m256i green = _mm256_and_si256(_mm256_srli_epi32(_mm256_mullo_epi32(_mm256_and_si256(texels, _mm256_set1_epi32(0x00FF00)), shade), 8),
+                                             _mm256_set1_epi32(0x00FF00));
+            return _mm256_or_si256(_mm256_or_si256(redBlue, green), _mm256_set1_epi32((int) 0xFF000000));
+        }
+
+        // Whole steps of 8 columns from the left edge, texels are gathered once for the floor and
+        // ceiling pixels and stored through each row's wall mask. Returns the columns done.
+        __attribute__((target("avx2")))
+        static int drawSpanAVX2(Uint32* floorRow, Uint32* ceilingRow, const FloorFrame& frame, const Span& span) {
+            const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+            __m256i u = _mm256_add_epi32(_mm256_set1_epi32((int) span.u), _mm256_mullo_epi32(lanes, _mm256_set1_epi32((int) span.du)));
+            __m256i v = _mm256_add_epi32(_mm256_set1_epi32((int) span.v), _mm256_mullo_epi32(lanes, _mm256_set1_epi32((int) span.dv)));
+            const __m256i stepU = _mm256_set1_epi32((int) (span.du * 8));
+            const __m256i stepV = _mm256_set1_epi32((int) (span.dv * 8));
+            const __m256i mask = _mm256_set1_epi32((1 << span.sizeBits) - 1);
+            const __m128i sizeBits = _mm_cvtsi32_si128(span.sizeBits);
+            const __m256i floorLimit = _mm256_set1_epi32(span.floorY + 1);
+            const __m256i ceilingY = _mm256_set1_epi32(span.ceilingY);
+            const __m256i floorShade = _mm256_set1_epi32(span.floorShade);
+            const __m256i ceilingShade = _mm256_set1_epi32(span.ceilingShade);
+
+            int x = 0;
+            for (; x + 8 <= frame.width; x += 8) {
+                __m256i floor = _mm256_cmpgt_epi32(floorLimit, _mm256_loadu_si256((const __m256i*) (frame.floorStarts + x)));
+                __m256i ceiling = _mm256_cmpgt_epi32(_mm256_loadu_si256((const __m256i*) (frame.ceilingEnds + x)), ceilingY);
+                __m256i either = _mm256_or_si256(floor, ceiling);
+                // columns of wall all the way across, usually near the horizon
+                if (!_mm256_testz_si256(either, either)) {
+                    __m256i row = _mm256_sll_epi32(_mm256_and_si256(_mm256_srli_epi32(v, 16), mask), sizeBits);
+                    __m256i index = _mm256_or_si256(row, _mm256_and_si256(_mm256_srli_epi32(u, 16), mask));
+                    __m256i texels = _mm256_i32gather_epi32((const int*) span.texels, index, 4);
+                    _mm256_maskstore_epi32((int*) (floorRow + x), floor, shadeTexels(texels, floorShade));
+                    _mm256_maskstore_epi32((int*) (ceilingRow + x), ceiling, shadeTexels(texels, ceilingShade));
+                }
+                u = _mm256_add_epi32(u, stepU);
+                v = _mm256_add_epi32(v, stepV);
+            }
+            return x;
+        }
+#endif
+};
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <utility>
+
+#include "room.hpp"
+#include "raycaster.hpp"
+#include "raypacket.hpp"
+#include "benchmark.hpp"
+
+// Differential test of the optimised ray paths against Ray2D, run with: ./dungeon --fuzz [seed]
+// Casts the same columns from random poses in rooms from Room's generator through Ray2D and
+// through each path, then reports how often they disagree on the hit cell or axis, the largest
+// distance error where they agree and rays per second.
+// Every path has a tolerance and run returns false if one is outside it, so changes to the ray
+// stage can be gated on it. Pass the printed seed back in to repeat a failing run.
+class RayFuzzer {
+    public:
+        static bool run(unsigned seed) {
+            Random random;  // seeds from the clock once, the seed below replaces it
+            srand(seed);
+            std::cout << "seed " << seed << ", " << roomCount << " rooms, " << posesPerRoom << " poses each, "
+                      << columns << " columns\n";
+
+            std::vector<Contender> contenders = {
+                // Ray2D nudges off grid lines by 1e-7 so even double paths differ slightly
+                {"blocks", castBlocks, 0.0001, 0.001},
+                {"distance field", castDistanceField, 0.0001, 0.001},
+                {"castPlain double", castPlain<double>, 0.0001, 0.001},
+                {"castPlain float", castPlain<float>, 0.0005, 0.05},
+                {"fixed", castFixed, 0.0005, 2},
+                {"castPlain fixed", castPlain<fixed>, 0.0005, 2},
+                {"reprojectRays 0.1 rad turn", castReprojected, 0.0001, 0.001},
+            };
+            // one per instruction set the CPU has rather than whichever it would pick
+            const Contender packets[] = {
+                {"RayPacket scalar", castPackets<PacketMode::scalarPacket>, 0.0005, 0.05},
+                {"RayPacket sse4.1", castPackets<PacketMode::sse4Packet>, 0.0005, 0.05},
+                {"RayPacket avx2", castPackets<PacketMode::avx2Packet>, 0.0005, 0.05},
+            };
+            PacketMode supported = RayPacket::getSupportedMode();
+            for (int mode = PacketMode::scalarPacket; mode <= supported; mode++) {
+                contenders.push_back(packets[mode]);
+            }
+
+            RayBatch reference;
+            RayBatch batch;
+            ColumnTable table;
+            double referenceSeconds = 0;
+            for (int r = 0; r < roomCount; r++) {
+                Room room(20, 20);
+                GridView grid = room.getMap();
+                double maxDistance = room.getMaxDistance();
+                for (Benchmark::Pose& pose : Benchmark::makePoses(grid, random, posesPerRoom)) {
+                    auto start = std::chrono::steady_clock::now();
+                    RayCaster::castRays(grid, pose.origin, pose.cameraPlane, columns, cellSize, maxDistance, table, reference, RayKernel::referenceKernel);
+                    referenceSeconds += Benchmark::secondsSince(start);
+
+                    for (Contender& contender : contenders) {
+                        start = std::chrono::steady_clock::now();
+                        contender.cast(grid, pose, maxDistance, table, batch);
+                        contender.seconds += Benchmark::secondsSince(start);
+                        compare(reference, batch, contender);
+                    }
+                }
+            }
+
+            long rays = (long) roomCount * posesPerRoom * columns;
+            std::cout << "  Ray2D: " << (long) (rays / referenceSeconds) << " rays/s\n";
+            bool passed = true;
+            for (Contender& contender : contenders) {
+                double mismatchRate = (double) contender.mismatches / rays;
+                bool ok = mismatchRate <= contender.maxMismatchRate && contender.maxError <= contender.errorTolerance;
+                passed = passed && ok;
+                std::cout << "  " << contender.name << ": " << 100 * mismatchRate << "% mismatched, max error "
+                          << contender.maxError << " px, " << (long) (rays / contender.seconds) << " rays/s, "
+                          << referenceSeconds / contender.seconds << "x" << (ok ? "" : "  FAILED") << '\n';
+            }
+            RayPacket::setMode(supported);
+            std::cout << (passed ? "passed" : "failed") << '\n';
+            return passed;
+        }
+
+    private:
+        static inline const int roomCount = 100;
+        static inline const int posesPerRoom = 20;
+        static inline const int columns = 800;
+        static inline const int cellSize = Benchmark::cellSize;
+
+        typedef void (*CastBatch)(const GridView& grid, const Benchmark::Pose& pose, double maxDistance, ColumnTable& table, RayBatch& out);
+
+        struct Contender {
+            const char* name;
+            CastBatch cast;
+            double maxMismatchRate;  // fraction of rays allowed to hit a different cell or axis
+            double errorTolerance;  // px, for rays that agree
+            long mismatches = 0;
+            double maxError = 0;
+            double seconds = 0;
+
+            Contender(const char* name, CastBatch cast, double maxMismatchRate, double errorTolerance) {
+                this->name = name;
+                this->cast = cast;
+                this->maxMismatchRate = maxMismatchRate;
+                this->errorTolerance = errorTolerance;
+            }
+        };
+
+        // Misses only compare whether they hit, Ray2D doesn't stop where the others do when
+        // a ray leaves the grid
+        static void compare(const RayBatch& reference, const RayBatch& batch, Contender& contender) {
+            for (int i = 0; i < reference.count; i++) {
+                if (reference.hit[i] != batch.hit[i]) {
+                    contender.mismatches++;
+                } else if (reference.hit[i]) {
+                    if (reference.cellX[i] != batch.cellX[i] || reference.cellY[i] != batch.cellY[i] || reference.axis[i] != batch.axis[i]) {
+                        contender.mismatches++;
+                    } else {
+                        contender.maxError = std::max(contender.maxError, fabs(reference.distance[i] - batch.distance[i]));
+                    }
+                }
+            }
+        }
+
+        static void castBlocks(const GridView& grid, const Benchmark::Pose& pose, double maxDistance, ColumnTable& table, RayBatch& out) {
+            RayCaster::castRays(grid, pose.origin, pose.cameraPlane, columns, cellSize, maxDistance, table, out, RayKernel::blockKernel);
+        }
+
+        static void castDistanceField(const GridView& grid, const Benchmark::Pose& pose, double maxDistance, ColumnTable& table, RayBatch& out) {
+            RayCaster::castRays(grid, pose.origin, pose.cameraPlane, columns, cellSize, maxDistance, table, out, RayKernel::distanceFieldKernel);
+        }
+
+        static void castFixed(const GridView& grid, const Benchmark::Pose& pose, double maxDistance, ColumnTable& table, RayBatch& out) {
+            RayCaster::castRays(grid, pose.origin, pose.cameraPlane, columns, cellSize, maxDistance, table, out, RayKernel::fixedKernel);
+        }
+
+        template <PacketMode packetMode>
+        static void castPackets(const GridView& grid, const Benchmark::Pose& pose, double maxDistance, ColumnTable& table, RayBatch& out) {
+            RayPacket::setMode(packetMode);
+            RayPacket::castRays(grid, pose.origin, pose.cameraPlane, columns, cellSize, maxDistance, table, out);
+        }
+
+        // Cast from the same spot facing a little to one side, then reprojected to face the pose.
+        // Timed along with the cast it starts from.
+        static void castReprojected(const GridView& grid, const Benchmark::Pose& pose, double maxDistance, ColumnTable& table, RayBatch& out) {
+            Benchmark::Pose turned = Benchmark::makePose(pose.origin, pose.rotRad + 0.1);
+            RayBatch previous;
+            RayCaster::castRays(grid, pose.origin, turned.cameraPlane, columns, cellSize, maxDistance, table, previous);
+            RayCaster::reprojectRays(grid, pose.origin, pose.cameraPlane, turned.cameraPlane, previous, columns, cellSize, maxDistance, table, out);
+        }
+
+        // a ray at a time along each column's unit direction
+        template <typename Scalar>
+        static void castPlain(const GridView& grid, const Benchmark::Pose& pose, double maxDistance, ColumnTable& table, RayBatch& out) {
+            out.resize(columns);
+            table.update(pose.origin, pose.cameraPlane, columns);
+            for (int i = 0; i < columns; i++) {
+                double dirX, dirY;
+                table.direction(i, dirX, dirY);
+                out.set(i, RayCaster::castPlain<Scalar>(grid, pose.origin, dirX, dirY, cellSize, maxDistance));
+            }
+            out.countSteps();
+        }
+};
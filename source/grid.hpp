@@ -0,0 +1,399 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <limits.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// Read-only, non-owning view of a row-major grid of map cells.
+// Small enough to pass by value, so rays and collision checks can share the room map
+// without copying it.
+struct GridView {
+    const char* cells = NULL;
+    int width = 0;
+    int height = 0;
+    int stride = 0;  // cells between the start of one row and the next
+    uint32_t version = 0;  // changes whenever any cell does, for caches of results that depend on the map
+
+    // Cell values. Walls stop rays. See-through walls (windows, grates, glass) are just as
+    // solid to the player and in the occupancy bits, but multi-hit rays record them and carry on.
+    static inline const char wallCell = '#';
+    static inline const char windowCell = '=';
+    static inline const char grateCell = '+';
+    static inline const char glassCell = '~';
+
+    static const bool seeThroughCell(char cell) {
+        return cell == windowCell || cell == grateCell || cell == glassCell;
+    }
+
+    static const bool solidCell(char cell) {
+        return cell == wallCell || seeThroughCell(cell);
+    }
+
+    // Occupancy bitsets, one bit per solid cell. Surrounded by a ring of solid padding cells
+    // so lookups one cell outside the grid need no bounds checks.
+    const uint64_t* rowBits = NULL;  // row-major, bit x + 1 of padded row y + 1
+    const uint64_t* columnBits = NULL;  // transposed copy for stepping along columns
+    int rowWords = 0;  // words per padded row
+    int columnWords = 0;  // words per padded column
+
+    // Coarser occupancy for skipping open space, counts of solid cells (padding included) in
+    // each block of the padded grid. Level 0 blocks are 8x8 and each level up doubles the side,
+    // up to the first level whose one block covers the whole padded grid.
+    static inline const int firstBlockShift = 3;
+    static inline const int maxBlockLevels = 28;  // enough for any grid an int can index
+    int blockLevels = 0;
+    const uint32_t* blockCounts[maxBlockLevels] = {};
+    int blockColumns[maxBlockLevels] = {};  // blocks per row
+
+    // Chebyshev distance from each padded cell to the nearest solid one, capped at maxDistance.
+    // A cell with distance d has no solid cells in the (2d - 1) square centred on it.
+    static inline const int maxDistance = 255;
+    const uint8_t* distances = NULL;
+    int distanceStride = 0;  // padded width
+
+    const bool inBounds(int x, int y) const {
+        return x >= 0 && y >= 0 && x < width && y < height;
+    }
+
+    // no bounds checking, use inBounds first if unsure
+    const char at(int x, int y) const {
+        return cells[y * stride + x];
+    }
+
+    // allows grid[y][x] access like the nested vectors it replaces
+    const char* operator[](int y) const {
+        return cells + y * stride;
+    }
+
+    // true for solid cells and the padding ring, x and y can be in [-1, width] and [-1, height]
+    const bool solid(int x, int y) const {
+        int bit = x + 1;
+        return (rowBits[(y + 1) * rowWords + (bit >> 6)] >> (bit & 63)) & 1;
+    }
+
+    // x and y can be in [-1, width] and [-1, height] like solid
+    const int distanceToWall(int x, int y) const {
+        return distances[(y + 1) * distanceStride + x + 1];
+    }
+
+    // solid but rays can see past it, false outside the grid
+    const bool seeThrough(int x, int y) const {
+        return inBounds(x, y) && seeThroughCell(at(x, y));
+    }
+
+    // log2 of the side of a block at the given level
+    static int blockShift(int level) {
+        return firstBlockShift + level;
+    }
+
+    // whether the block containing (x, y) at the given level has no solid cells
+    const bool blockEmpty(int level, int x, int y) const {
+        int shift = blockShift(level);
+        return blockCounts[level][((y + 1) >> shift) * blockColumns[level] + ((x + 1) >> shift)] == 0;
+    }
+
+    // inclusive range of cells covered by the block containing cell c at the given level
+    static void blockRange(int level, int c, int& first, int& last) {
+        int shift = blockShift(level);
+        first = (((c + 1) >> shift) << shift) - 1;
+        last = first + (1 << shift) - 1;
+    }
+
+    // cells from (x, y) to the next solid cell along the row, stepping by step (1 or -1)
+    const int distanceToSolidInRow(int x, int y, int step) const {
+        return distanceToSolid(rowBits + (y + 1) * rowWords, x + 1, step);
+    }
+
+    // cells from (x, y) to the next solid cell along the column, stepping by step (1 or -1)
+    const int distanceToSolidInColumn(int x, int y, int step) const {
+        return distanceToSolid(columnBits + (x + 1) * columnWords, y + 1, step);
+    }
+
+    // scans whole words at a time, always finds a cell because of the padding
+    static int distanceToSolid(const uint64_t* words, int bit, int step) {
+        if (step > 0) {
+            int start = bit + 1;
+            int word = start >> 6;
+            uint64_t mask = words[word] & (~0ULL << (start & 63));
+            while (mask == 0) {
+                mask = words[++word];
+            }
+            return word * 64 + __builtin_ctzll(mask) - bit;
+        }
+        int start = bit - 1;
+        int word = start >> 6;
+        uint64_t mask = words[word] & (~0ULL >> (63 - (start & 63)));
+        while (mask == 0) {
+            mask = words[--word];
+        }
+        return bit - (word * 64 + 63 - __builtin_clzll(mask));
+    }
+};
+
+// Compile time choices of which cells stop a ray, for RayCaster::traverse.
+// The padding round the grid stops every one of them.
+
+// walls and see-through cells, everything the renderer draws
+struct SolidCells {
+    static bool stops(const GridView& grid, int x, int y) {
+        return grid.solid(x, y);
+    }
+};
+
+// only cells that can't be seen through, for line of sight
+struct OpaqueCells {
+    static bool stops(const GridView& grid, int x, int y) {
+        return grid.solid(x, y) && !grid.seeThrough(x, y);
+    }
+};
+
+// any of the listed cell types, e.g. CellSet<GridView::grateCell> to find grates
+template <char... cells>
+struct CellSet {
+    static bool stops(const GridView& grid, int x, int y) {
+        if (!grid.inBounds(x, y)) {
+            return true;
+        }
+        char cell = grid.at(x, y);
+        return ((cell == cells) || ...);
+    }
+};
+
+// Owns the cells of a map in a single contiguous allocation, along with occupancy
+// bitsets of its solid cells that are kept in sync as cells are set.
+// The distance field is updated lazily, edits mark the area around them dirty and it is
+// recomputed the next time a view is taken (or refreshDistances is called).
+class Grid {
+    public:
+        Grid() {}
+
+        Grid(int width, int height, char fill) {
+            resize(width, height, fill);
+        }
+
+        const int getWidth() const {
+            return width;
+        }
+
+        const int getHeight() const {
+            return height;
+        }
+
+        const uint32_t getVersion() const {
+            return version;
+        }
+
+        void resize(int width, int height, char fill) {
+            this->width = width;
+            this->height = height;
+            version++;
+            cells.assign(width * height, fill);
+            rebuildBits();
+        }
+
+        void clear() {
+            resize(0, 0, '\0');
+        }
+
+        // no bounds checking
+        const char at(int x, int y) const {
+            return cells[y * width + x];
+        }
+
+        const char* operator[](int y) const {
+            return &cells[y * width];
+        }
+
+        // all writes go through here so the bitsets and block counts stay in sync
+        void set(int x, int y, char cell) {
+            bool wasSolid = GridView::solidCell(cells[y * width + x]);
+            bool isSolid = GridView::solidCell(cell);
+            if (cells[y * width + x] != cell) {
+                version++;
+            }
+            cells[y * width + x] = cell;
+            setBit(x + 1, y + 1, isSolid);
+            if (wasSolid != isSolid) {
+                countBlocks(x + 1, y + 1, isSolid ? 1 : -1);
+                markDistancesDirty(x + 1, y + 1);
+            }
+        }
+
+        // Brings the distance field up to date with any edits since it was last computed.
+        // Only cells within maxDistance of an edit can change, so only that area is redone.
+        void refreshDistances() const {
+            if (dirtyMinX > dirtyMaxX) {
+                return;
+            }
+            int paddedWidth = width + 2;
+            int paddedHeight = height + 2;
+            int minX = std::max(dirtyMinX - GridView::maxDistance, 0);
+            int maxX = std::min(dirtyMaxX + GridView::maxDistance, paddedWidth - 1);
+            int minY = std::max(dirtyMinY - GridView::maxDistance, 0);
+            int maxY = std::min(dirtyMaxY + GridView::maxDistance, paddedHeight - 1);
+            dirtyMinX = dirtyMinY = INT_MAX;
+            dirtyMaxX = dirtyMaxY = INT_MIN;
+
+            for (int py = minY; py <= maxY; py++) {
+                for (int px = minX; px <= maxX; px++) {
+                    distances[py * paddedWidth + px] = paddedSolid(px, py) ? 0 : GridView::maxDistance;
+                }
+            }
+            // Two pass chessboard transform. Cells just outside the area are further than
+            // maxDistance from every edit so their values are still right and seed the passes.
+            // Rosenfeld & Pfaltz, Distance functions on digital pictures (1968)
+            for (int py = minY; py <= maxY; py++) {
+                for (int px = minX; px <= maxX; px++) {
+                    int d = distances[py * paddedWidth + px];
+                    if (px > 0) { d = std::min(d, distances[py * paddedWidth + px - 1] + 1); }
+                    if (py > 0) {
+                        const uint8_t* above = &distances[(py - 1) * paddedWidth + px];
+                        d = std::min(d, above[0] + 1);
+                        if (px > 0) { d = std::min(d, above[-1] + 1); }
+                        if (px < paddedWidth - 1) { d = std::min(d, above[1] + 1); }
+                    }
+                    distances[py * paddedWidth + px] = d;
+                }
+            }
+            for (int py = maxY; py >= minY; py--) {
+                for (int px = maxX; px >= minX; px--) {
+                    int d = distances[py * paddedWidth + px];
+                    if (px < paddedWidth - 1) { d = std::min(d, distances[py * paddedWidth + px + 1] + 1); }
+                    if (py < paddedHeight - 1) {
+                        const uint8_t* below = &distances[(py + 1) * paddedWidth + px];
+                        d = std::min(d, below[0] + 1);
+                        if (px > 0) { d = std::min(d, below[-1] + 1); }
+                        if (px < paddedWidth - 1) { d = std::min(d, below[1] + 1); }
+                    }
+                    distances[py * paddedWidth + px] = d;
+                }
+            }
+        }
+
+        const GridView view() const {
+            refreshDistances();
+            GridView v;
+            v.cells = cells.data();
+            v.width = width;
+            v.height = height;
+            v.stride = width;
+            v.version = version;
+            v.rowBits = rowBits.data();
+            v.columnBits = columnBits.data();
+            v.rowWords = rowWords;
+            v.columnWords = columnWords;
+            v.blockLevels = (int) blockCounts.size();
+            for (int level = 0; level < v.blockLevels; level++) {
+                v.blockCounts[level] = blockCounts[level].data();
+                v.blockColumns[level] = blockColumns[level];
+            }
+            v.distances = distances.data();
+            v.distanceStride = width + 2;
+            return v;
+        }
+
+    private:
+        std::vector<char> cells;
+        int width = 0;
+        int height = 0;
+        uint32_t version = 0;
+
+        std::vector<uint64_t> rowBits;
+        std::vector<uint64_t> columnBits;
+        int rowWords = 0;
+        int columnWords = 0;
+        std::vector<std::vector<uint32_t>> blockCounts;  // per level, sized from the map by rebuildBits
+        std::vector<int> blockColumns;
+
+        // padded like the bitsets, recomputed on demand from const views
+        mutable std::vector<uint8_t> distances;
+        mutable int dirtyMinX = INT_MAX;  // padded coords of edited cells not yet in the field
+        mutable int dirtyMaxX = INT_MIN;
+        mutable int dirtyMinY = INT_MAX;
+        mutable int dirtyMaxY = INT_MIN;
+
+        // padded coords
+        const bool paddedSolid(int px, int py) const {
+            return (rowBits[py * rowWords + (px >> 6)] >> (px & 63)) & 1;
+        }
+
+        // padded coords
+        void markDistancesDirty(int px, int py) {
+            dirtyMinX = std::min(dirtyMinX, px);
+            dirtyMaxX = std::max(dirtyMaxX, px);
+            dirtyMinY = std::min(dirtyMinY, py);
+            dirtyMaxY = std::max(dirtyMaxY, py);
+        }
+
+        // padded coords
+        void countBlocks(int px, int py, int change) {
+            for (int level = 0; level < (int) blockCounts.size(); level++) {
+                int shift = GridView::blockShift(level);
+                blockCounts[level][(py >> shift) * blockColumns[level] + (px >> shift)] += change;
+            }
+        }
+
+        // padded coords
+        void setBit(int px, int py, bool solid) {
+            uint64_t& rowWord = rowBits[py * rowWords + (px >> 6)];
+            uint64_t& columnWord = columnBits[px * columnWords + (py >> 6)];
+            if (solid) {
+                rowWord |= 1ULL << (px & 63);
+                columnWord |= 1ULL << (py & 63);
+            } else {
+                rowWord &= ~(1ULL << (px & 63));
+                columnWord &= ~(1ULL << (py & 63));
+            }
+        }
+
+        void rebuildBits() {
+            // padding and any unused bits at the end of each word start solid
+            rowWords = (width + 2 + 63) / 64;
+            columnWords = (height + 2 + 63) / 64;
+            rowBits.assign((height + 2) * rowWords, ~0ULL);
+            columnBits.assign((width + 2) * columnWords, ~0ULL);
+            for (int y = 0; y < height; y++) {
+                for (int x = 0; x < width; x++) {
+                    setBit(x + 1, y + 1, GridView::solidCell(cells[y * width + x]));
+                }
+            }
+
+            // levels double until one block covers the padded grid, so open space of any size
+            // is crossed in a number of jumps that grows with the log of its size
+            int levels = 1;
+            while (levels < GridView::maxBlockLevels && (1 << GridView::blockShift(levels - 1)) < std::max(width, height) + 2) {
+                levels++;
+            }
+            blockCounts.resize(levels);
+            blockColumns.resize(levels);
+            for (int level = 0; level < levels; level++) {
+                int shift = GridView::blockShift(level);
+                blockColumns[level] = ((width + 2) >> shift) + 1;
+                blockCounts[level].assign((((height + 2) >> shift) + 1) * blockColumns[level], 0);
+            }
+            for (int py = 0; py < height + 2; py++) {
+                for (int px = 0; px < width + 2; px++) {
+                    bool padding = px == 0 || py == 0 || px == width + 1 || py == height + 1;
+                    if (padding || GridView::solidCell(cells[(py - 1) * width + (px - 1)])) {
+                        blockCounts[0][(py >> GridView::firstBlockShift) * blockColumns[0] + (px >> GridView::firstBlockShift)]++;
+                    }
+                }
+            }
+            // each block above is the sum of the four below it
+            for (int level = 1; level < levels; level++) {
+                int belowRows = (int) blockCounts[level - 1].size() / blockColumns[level - 1];
+                for (int by = 0; by < belowRows; by++) {
+                    for (int bx = 0; bx < blockColumns[level - 1]; bx++) {
+                        blockCounts[level][(by >> 1) * blockColumns[level] + (bx >> 1)] += blockCounts[level - 1][by * blockColumns[level - 1] + bx];
+                    }
+                }
+            }
+
+            // whole field is redone before the next view
+            distances.assign((width + 2) * (height + 2), 0);
+            markDistancesDirty(0, 0);
+            markDistancesDirty(width + 1, height + 1);
+        }
+};
@@ -6,11 +6,33 @@
 #include "window.hpp"
 #include "input.hpp"
 #include "room.hpp"
+#include "benchmark.hpp"
+#include "fuzzer.hpp"
+#include "threadpool.hpp"
+#include "resolution.hpp"
 
 int main(int argc, char* argv[]) {
+    // headless timings, no window needed
+    if (argc > 1 && std::string(argv[1]) == "--bench") {
+        Benchmark::run();
+        return 0;
+    }
+    // checks the optimised ray paths against Ray2D, exits non zero if any are out of tolerance
+    if (argc > 1 && std::string(argv[1]) == "--fuzz") {
+        unsigned seed = (argc > 2) ? std::stoul(argv[2]) : time(0);
+        return RayFuzzer::run(seed) ? 0 : 1;
+    }
+
+    // --threads n draws 3D frames with n threads, 1 for none, default one per core
+    if (argc > 2 && std::string(argv[1]) == "--threads") {
+        Room::setThreadCount(std::stoi(argv[2]));
+    }
+
     const int targetFps = 60;  // SDL auto caps at 60
     const int ticksPerFrame = 1000 / targetFps;  // a tick is a ms
     Window window = Window(RenderMode::hardwareRendering);
+    // 3D frames are drawn smaller when they take too long, leaving time for the rest of the frame
+    ResolutionController resolution((double) 1 / targetFps, Window::screenWidth, Window::screenHeight);
 
     Room firstRoom = Room(20, 20);
     Room* currentRoom = &firstRoom;
@@ -29,27 +51,53 @@ int main(int argc, char* argv[]) {
         // read input once to be accessed by any system
         Input::readEvents(window);
         std::unordered_map<SDL_Keycode, bool> press = Input::getPressed();
+        std::unordered_map<SDL_Keycode, bool> keydowns = Input::getKeydowns();
         run = !Input::getQuit() && !press[SDLK_COMMA];
+        // compare framebuffer layouts
+        if (keydowns[SDLK_4]) {
+            window.setPixelLayout((window.getPixelLayout() == PixelLayout::rowMajor) ? PixelLayout::columnMajor : PixelLayout::rowMajor);
+            std::cout << "pixel layout: " << ((window.getPixelLayout() == PixelLayout::rowMajor) ? "row major" : "column major") << '\n';
+        }
+        // full resolution to compare against
+        if (keydowns[SDLK_8]) {
+            resolution.setEnabled(!resolution.getEnabled());
+            std::cout << "dynamic resolution: " << (resolution.getEnabled() ? "on" : "off") << '\n';
+        }
 
         // update
         currentRoom = (*currentRoom).update(dt);
 
-        // render
-        window.clear();
+        // render, the room clears the window if its draw mode doesn't cover every pixel
+        window.setRenderSize(resolution.getWidth(), resolution.getHeight());
+        Uint64 drawStart = SDL_GetPerformanceCounter();
         (*currentRoom).draw(window);
+        // 2D draws with the renderer at the window's size, so only 3D frames are counted
+        if (!Room::getDrawMode2D()) {
+            resolution.addFrame((double) (SDL_GetPerformanceCounter() - drawStart) / SDL_GetPerformanceFrequency());
+        }
         window.renderSurfaceFillScreen(grassImg);
         window.renderScaledSurface(grassImg, Point2D(50, 30), 4, 0.5);
         window.presentRender();
 
         // delay to cap frame rate
         Uint64 frameTime = SDL_GetTicks64() - frameTimer;
+        Uint64 workTime = frameTime;  // time spent before the cap kicks in
         if (frameTime < ticksPerFrame) {
              SDL_Delay(ticksPerFrame - frameTime);
         }
 
-        // display fps in window title
+        // display fps, ray cost and how busy the render threads were in window title
         frameTime = SDL_GetTicks64() - frameTimer;
-        window.setTitle(std::to_string((double) 1000 / frameTime));
+        ThreadPool::Stats threadStats = ThreadPool::shared().takeStats();
+        window.setTitle(std::to_string((double) 1000 / frameTime) + " fps, "
+                        + std::to_string(workTime) + " ms, "
+                        + std::to_string(window.getRenderWidth()) + "x" + std::to_string(window.getRenderHeight()) + ", "
+                        + RayCaster::getKernelName(Room::getRayKernel()) + ", "
+                        + std::to_string((*currentRoom).getFrameSteps()) + " steps ("
+                        + std::to_string((*currentRoom).getStepsPerRay()) + "/ray), "
+                        + std::to_string(ThreadPool::shared().getThreadCount()) + " threads "
+                        + std::to_string((int) (100 * threadStats.idleFraction())) + "% idle "
+                        + std::to_string(threadStats.steals) + " steals");
 
     }
 
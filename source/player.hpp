@@ -5,6 +5,7 @@
 
 #include "window.hpp"
 #include "point.hpp"
+#include "grid.hpp"
 
 #define EMPTY '.'
 
@@ -71,15 +72,14 @@ class Player : public Point2D {
             set(p.x(), p.y());
         }
 
-        void update(double dt, std::vector<std::vector<char>> map, int wallSize) {
+        void update(double dt, const GridView& map, int wallSize) {
             double prevRotRad = rotRad; 
             Point2D movedPlayer = getInput(dt);
 
             // check player collisions
             Point2D mapNormalisedPlayer((int) movedPlayer.x() / wallSize, (int) movedPlayer.y() / wallSize);
-            bool inMap = mapNormalisedPlayer.x() >= 0 && mapNormalisedPlayer.y() >= 0 && 
-                         mapNormalisedPlayer.x() < map[0].size() && mapNormalisedPlayer.y() < map.size();
-            if (inMap && map[mapNormalisedPlayer.y()][mapNormalisedPlayer.x()] == EMPTY) {
+            bool inMap = map.inBounds(mapNormalisedPlayer.x(), mapNormalisedPlayer.y());
+            if (inMap && map.at(mapNormalisedPlayer.x(), mapNormalisedPlayer.y()) == EMPTY) {
                 set(movedPlayer);
             }
 
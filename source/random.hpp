@@ -8,7 +8,11 @@
 class Random {
     public:
         Random() {
-            srand(time(0));
+            // seed once, reseeding with the same second would repeat the same sequence
+            if (!seeded) {
+                srand(time(0));
+                seeded = true;
+            }
         }
 
         // generates a random int in [0, maxRange)
@@ -38,4 +42,5 @@ class Random {
         }
 
     private:
+        static inline bool seeded = false;
 };
\ No newline at end of file
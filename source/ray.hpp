@@ -5,6 +5,7 @@
 #include <vector>
 #include "utilities.hpp"
 #include "point.hpp"
+#include "grid.hpp"
 
 enum RayHitAxis {
     none,
@@ -12,9 +13,11 @@ enum RayHitAxis {
     horizontal
 };
 
+// Original two pass caster. Rendering now goes through RayCaster (raycaster.hpp),
+// this is kept as the reference that faster kernels are checked against.
 class Ray2D {
     public:
-        Ray2D(Point2D& origin, double angleRad, int dof, double cellSize, std::vector<std::vector<char>>& grid) {
+        Ray2D(const Point2D& origin, double angleRad, int dof, double cellSize, const GridView& grid) {
             this->origin = origin;
             rayAngleRad = wrapRadAngle(angleRad);
             maxDof = dof;
@@ -39,6 +42,11 @@ class Ray2D {
             return hitPos;
         }
 
+        // grid cells checked across both passes
+        const int getSteps() const {
+            return steps;
+        }
+
         // Returns the gridline axis that the ray collided with
         const RayHitAxis getHitAxis() {
             return hitAxis;
@@ -57,8 +65,8 @@ class Ray2D {
             double xOffset, yOffset;  // offset to jump to next vert or hori grid line (same every jump)
             double horiX, horiY;  // cache hori ray hit point while computing vert
 
-            bool horiHit, vertHit;
-            double vertRayDist, horiRayDist;  // store length of both rays for comparison
+            bool horiHit = false, vertHit = false;
+            double vertRayDist = 0, horiRayDist = 0;  // store length of both rays for comparison
             double infiniteDist = cellSize * maxDof + 1;  // largest distance possible in dof + 1
 
             double negTan = -tan(rayAngleRad);
@@ -84,10 +92,11 @@ class Ray2D {
                 horiRayDist = infiniteDist;
             }
             while (dof < maxDof) {
-                gridX = (int) rayX / cellSize;
-                gridY = (int) rayY / cellSize;
+                steps++;
+                gridX = (int) floor(rayX / cellSize);  // floor so cells left of / above the grid are negative
+                gridY = (int) floor(rayY / cellSize);
                 // has hit (is within grid and cell is filled)
-                if (gridX >= 0 && gridY >= 0 && gridX < grid[0].size() && gridY < grid.size() && grid[gridY][gridX] == '#') {
+                if (grid.inBounds(gridX, gridY) && GridView::solidCell(grid.at(gridX, gridY))) {
                     horiHit = true;
                     break;
                 // check next horizontal grid line
@@ -125,10 +134,11 @@ class Ray2D {
                 vertRayDist = infiniteDist;
             }
             while (dof < maxDof) {
-                gridX = (int) rayX / cellSize;
-                gridY = (int) rayY / cellSize;
+                steps++;
+                gridX = (int) floor(rayX / cellSize);
+                gridY = (int) floor(rayY / cellSize);
                 // has hit (is within grid and cell is filled)
-                if (gridX >= 0 && gridY >= 0 && gridX < grid[0].size() && gridY < grid.size() && grid[gridY][gridX] == '#') {
+                if (grid.inBounds(gridX, gridY) && GridView::solidCell(grid.at(gridX, gridY))) {
                     vertHit = true;
                     break;
                 // check next horizontal grid line
@@ -162,12 +172,13 @@ class Ray2D {
 
     private:
         int cellSize;
-        std::vector<std::vector<char>> grid;
+        GridView grid;  // non-owning, map must outlive the ray
         int maxDof;
         double rayAngleRad;
 
         double length = 0;
         bool hit = false;
+        int steps = 0;
         RayHitAxis hitAxis = RayHitAxis::none;
         Point2D origin = Point2D(0, 0);
         Point2D hitPos = Point2D(0, 0);
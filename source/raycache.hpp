@@ -0,0 +1,114 @@
+#pragma once
+
+#include <utility>
+#include <stdint.h>
+#include "point.hpp"
+#include "grid.hpp"
+#include "raycaster.hpp"
+
+// Everything a batch of ray results depends on. Two frames with equal poses cast
+// exactly the same rays into the same map.
+struct RayPose {
+    double originX = 0, originY = 0;
+    double rotRad = 0;
+    double planeLeftX = 0, planeLeftY = 0;
+    double planeRightX = 0, planeRightY = 0;
+    uint32_t mapVersion = 0;
+    int columnCount = 0;
+    double cellSize = 0;
+    double maxDistance = 0;
+    RayKernel kernel = RayKernel::blockKernel;
+
+    RayPose() {}
+
+    RayPose(const GridView& grid, const Point2D& origin, double rotRad, const std::pair<Point2D, Point2D>& cameraPlane,
+            int columnCount, double cellSize, double maxDistance, RayKernel kernel) {
+        originX = origin.x();
+        originY = origin.y();
+        this->rotRad = rotRad;
+        planeLeftX = cameraPlane.first.x();
+        planeLeftY = cameraPlane.first.y();
+        planeRightX = cameraPlane.second.x();
+        planeRightY = cameraPlane.second.y();
+        mapVersion = grid.version;
+        this->columnCount = columnCount;
+        this->cellSize = cellSize;
+        this->maxDistance = maxDistance;
+        this->kernel = kernel;
+    }
+
+    // exact comparison, any movement at all has to recast
+    bool operator==(const RayPose& p) const {
+        return originX == p.originX && originY == p.originY && rotRad == p.rotRad
+            && planeLeftX == p.planeLeftX && planeLeftY == p.planeLeftY
+            && planeRightX == p.planeRightX && planeRightY == p.planeRightY
+            && mapVersion == p.mapVersion && columnCount == p.columnCount
+            && cellSize == p.cellSize && maxDistance == p.maxDistance && kernel == p.kernel;
+    }
+
+    bool operator!=(const RayPose& p) const {
+        return !(*this == p);
+    }
+
+    // same except for which way the camera faces
+    bool sameOrigin(const RayPose& p) const {
+        return originX == p.originX && originY == p.originY
+            && mapVersion == p.mapVersion && columnCount == p.columnCount
+            && cellSize == p.cellSize && maxDistance == p.maxDistance && kernel == p.kernel;
+    }
+
+    const std::pair<Point2D, Point2D> getCameraPlane() const {
+        return std::make_pair(Point2D(planeLeftX, planeLeftY), Point2D(planeRightX, planeRightY));
+    }
+};
+
+// Remembers the pose the batch it sits beside was last cast from, so frames where the
+// player hasn't moved or turned and the map hasn't changed can reuse the results.
+// Moving in Player::update changes the pose and editing the map changes its version,
+// so either makes the next lookup miss without having to be told.
+// When the player has only turned the old batch can be reprojected (RayCaster::reprojectRays)
+// instead of recast.
+class RayCache {
+    public:
+        int hits = 0;  // lookups that reused the batch
+        int misses = 0;
+        int turns = 0;  // misses where only the rotation changed
+
+        // true if the batch already holds results for this pose, otherwise the caller
+        // casts and then calls store
+        bool lookup(const RayPose& pose) {
+            if (cached && pose == cachedPose) {
+                hits++;
+                return true;
+            }
+            misses++;
+            return false;
+        }
+
+        // true if the batch was cast from the same place and only needs turning to match pose
+        bool canReproject(const RayPose& pose) {
+            if (cached && pose.sameOrigin(cachedPose)) {
+                turns++;
+                return true;
+            }
+            return false;
+        }
+
+        const RayPose& getPose() const {
+            return cachedPose;
+        }
+
+        void store(const RayPose& pose) {
+            cachedPose = pose;
+            cached = true;
+        }
+
+        // for when the batch is written by something other than a cached cast
+        void invalidate() {
+            cached = false;
+        }
+
+    private:
+        bool cached = false;
+        RayPose cachedPose;
+};
@@ -0,0 +1,840 @@
+#pragma once
+
+#include <math.h>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include "point.hpp"
+#include "grid.hpp"
+#include "ray.hpp"
+#include "fixed.hpp"
+#include "columntable.hpp"
+
+// Side of the hit cell that the ray entered through
+enum RayHitFace {
+    noFace,
+    leftFace,  // entered moving +x
+    rightFace,  // entered moving -x
+    topFace,  // entered moving +y
+    bottomFace  // entered moving -y
+};
+
+// Ways of finding what a ray hits, switchable at runtime to compare them
+enum RayKernel {
+    referenceKernel,  // Ray2D
+    blockKernel,  // RayCaster::cast, jumps empty blocks and runs
+    distanceFieldKernel,  // RayCaster::castDistanceField, leaps by the distance to the nearest wall
+    fixedKernel  // RayCaster::castFixed, 16.16 fixed point stepping
+};
+
+struct RayHit {
+    bool hit = false;
+    double distance = 0;  // in multiples of the cast direction's length
+    double hitX = 0;  // end point of the ray in world coords
+    double hitY = 0;
+    int cellX = -1;  // grid cell that was hit
+    int cellY = -1;
+    RayHitAxis axis = RayHitAxis::none;
+    RayHitFace face = RayHitFace::noFace;
+    double wallU = 0;  // [0, 1) position along the hit face
+    int steps = 0;  // grid cells visited
+};
+
+// Everything one ray hit, nearest first, for rays that carry on through see-through cells.
+// Fixed size and held inline so a list can sit on the stack in the per column loop.
+struct RayHitList {
+    static inline const int capacity = 4;
+    int count = 0;
+    RayHit hits[capacity];
+};
+
+// Results for a row of rays (usually one per screen column) stored as parallel arrays,
+// so consumers can stream through one field at a time.
+// Storage is reused between frames and only reallocated when the column count grows.
+class RayBatch {
+    public:
+        int count = 0;
+        int totalSteps = 0;  // grid cells visited by the whole batch, summed by countSteps
+        std::vector<double> distance;  // euclidean
+        std::vector<double> perpDistance;  // distance along the view axis (fisheye corrected)
+        std::vector<char> hit;  // char not bool so it stays a plain contiguous array
+        std::vector<RayHitAxis> axis;
+        std::vector<int> cellX;
+        std::vector<int> cellY;
+        std::vector<double> wallU;
+        std::vector<double> hitX;  // end point of each ray in world coords
+        std::vector<double> hitY;
+        std::vector<fixed> perpDistanceFixed;  // in cells, only filled by the fixed point kernel
+        std::vector<int> steps;  // per column so columns can be cast from different threads
+
+        void resize(int count) {
+            this->count = count;
+            if (count > (int) distance.size()) {
+                distance.resize(count);
+                perpDistance.resize(count);
+                hit.resize(count);
+                axis.resize(count);
+                cellX.resize(count);
+                cellY.resize(count);
+                wallU.resize(count);
+                hitX.resize(count);
+                hitY.resize(count);
+                perpDistanceFixed.resize(count);
+                steps.resize(count);
+            }
+        }
+
+        void set(int i, const RayHit& ray) {
+            distance[i] = ray.distance;
+            hit[i] = ray.hit;
+            axis[i] = ray.axis;
+            cellX[i] = ray.cellX;
+            cellY[i] = ray.cellY;
+            wallU[i] = ray.wallU;
+            hitX[i] = ray.hitX;
+            hitY[i] = ray.hitY;
+            steps[i] = ray.steps;
+        }
+
+        void countSteps() {
+            totalSteps = 0;
+            for (int i = 0; i < count; i++) {
+                totalSteps += steps[i];
+            }
+        }
+};
+
+// State of one ray part way through a grid, in grid units so each cell is 1x1.
+// Kernels share it so they all step, skip and jump the same way.
+struct RayTraversal {
+    double originX, originY;
+    double dirX, dirY;
+    int cellX, cellY;
+    int stepX, stepY;
+    double deltaX, deltaY;  // distance along the ray between consecutive vertical (x) and horizontal (y) grid lines
+    double sideX, sideY;  // distance along the ray to the next vertical and horizontal grid line
+    double t = 0;  // distance along the ray to the last grid line crossed
+    RayHitAxis axis = RayHitAxis::none;
+
+    RayTraversal(double originX, double originY, double dirX, double dirY) {
+        this->originX = originX;
+        this->originY = originY;
+        this->dirX = dirX;
+        this->dirY = dirY;
+        cellX = (int) floor(originX);
+        cellY = (int) floor(originY);
+
+        const double infinity = 1e30;
+        deltaX = (dirX != 0) ? fabs(1 / dirX) : infinity;
+        deltaY = (dirY != 0) ? fabs(1 / dirY) : infinity;
+        stepX = (dirX < 0) ? -1 : 1;
+        stepY = (dirY < 0) ? -1 : 1;
+        sideX = (dirX < 0) ? (originX - cellX) * deltaX : (cellX + 1 - originX) * deltaX;
+        sideY = (dirY < 0) ? (originY - cellY) * deltaY : (cellY + 1 - originY) * deltaY;
+    }
+
+    // distance along the ray to the next grid line step() would cross
+    const double nextT() const {
+        return (sideX < sideY) ? sideX : sideY;
+    }
+
+    // step across the nearer grid line
+    void step() {
+        if (sideX < sideY) {
+            t = sideX;
+            sideX += deltaX;
+            cellX += stepX;
+            axis = RayHitAxis::vertical;
+        } else {
+            t = sideY;
+            sideY += deltaY;
+            cellY += stepY;
+            axis = RayHitAxis::horizontal;
+        }
+    }
+
+    // cross count vertical grid lines, caller makes sure no horizontal one comes first
+    void skipX(int count) {
+        t = sideX + (count - 1) * deltaX;
+        sideX += count * deltaX;
+        cellX += count * stepX;
+        axis = RayHitAxis::vertical;
+    }
+
+    // cross count horizontal grid lines, caller makes sure no vertical one comes first
+    void skipY(int count) {
+        t = sideY + (count - 1) * deltaY;
+        sideY += count * deltaY;
+        cellY += count * stepY;
+        axis = RayHitAxis::horizontal;
+    }
+
+    // Steps along the current row (or column) that are safe to skip before the ray must cross
+    // into the next one. One short so rounding can never skip a row.
+    const int runLength() const {
+        double run = (sideX < sideY) ? (sideY - sideX) * fabs(dirX) : (sideX - sideY) * fabs(dirY);
+        // axis aligned rays never leave their row
+        if (run > 1e9) {
+            return 1000000000;
+        }
+        return (int) run - 1;
+    }
+
+    // Jumps straight out of the box of cells [minX, maxX] x [minY, maxY] around the current cell,
+    // which the caller knows is empty, and into the first cell past it.
+    // Does nothing and returns false if the jump would land further along the ray than maxT.
+    bool leaveBox(int minX, int maxX, int minY, int maxY, double maxT) {
+        // crossings needed to leave the box on each axis and where along the ray they happen
+        int exitX = (stepX > 0) ? maxX + 1 - cellX : cellX - minX + 1;
+        int exitY = (stepY > 0) ? maxY + 1 - cellY : cellY - minY + 1;
+        double exitTX = sideX + (exitX - 1) * deltaX;
+        double exitTY = sideY + (exitY - 1) * deltaY;
+
+        if (exitTX < exitTY) {
+            // horizontal lines crossed on the way, sideY <= sideX picks y like step() does
+            int passed = (sideY > exitTX) ? 0 : (int) floor((exitTX - sideY) / deltaY) + 1;
+            passed = std::min(passed, exitY - 1);
+            if (exitTX > maxT) {
+                return false;
+            }
+            if (passed > 0) {
+                skipY(passed);
+            }
+            skipX(exitX);
+        } else {
+            int passed = (sideX >= exitTY) ? 0 : (int) ceil((exitTY - sideX) / deltaX);
+            passed = std::min(passed, exitX - 1);
+            if (exitTY > maxT) {
+                return false;
+            }
+            if (passed > 0) {
+                skipX(passed);
+            }
+            skipY(exitY);
+        }
+        return true;
+    }
+};
+
+// Arithmetic RayCaster::traverse can be built on. Floating point types divide for grid
+// line spacing, fixed point looks it up with Fixed::reciprocal.
+template <typename Scalar>
+struct RayScalar;
+
+template <>
+struct RayScalar<double> {
+    static constexpr double one = 1;
+    static constexpr double infinity = 1e30;
+    static double fromDouble(double d) { return d; }
+    static double toDouble(double s) { return s; }
+    static double fromInt(int i) { return i; }
+    static int floor(double s) { return (int) ::floor(s); }
+    static double mul(double a, double b) { return a * b; }
+    static double reciprocal(double s) { return (s != 0) ? 1 / s : infinity; }
+};
+
+template <>
+struct RayScalar<float> {
+    static constexpr float one = 1;
+    static constexpr float infinity = 1e30f;
+    static float fromDouble(double d) { return (float) d; }
+    static double toDouble(float s) { return s; }
+    static float fromInt(int i) { return (float) i; }
+    static int floor(float s) { return (int) floorf(s); }
+    static float mul(float a, float b) { return a * b; }
+    static float reciprocal(float s) { return (s != 0) ? 1 / s : infinity; }
+};
+
+template <>
+struct RayScalar<fixed> {
+    static constexpr fixed one = Fixed::one;
+    static constexpr fixed infinity = Fixed::infinity;
+    // saturates so huge budgets don't wrap
+    static fixed fromDouble(double d) {
+        if (d * Fixed::one >= Fixed::infinity) { return Fixed::infinity; }
+        if (d * Fixed::one <= -Fixed::infinity) { return -Fixed::infinity; }
+        return Fixed::fromDouble(d);
+    }
+    static double toDouble(fixed s) { return Fixed::toDouble(s); }
+    static fixed fromInt(int i) { return Fixed::fromInt(i); }
+    static int floor(fixed s) { return Fixed::toInt(s); }
+    static fixed mul(fixed a, fixed b) { return Fixed::mul(a, b); }
+    static fixed reciprocal(fixed s) { return Fixed::reciprocal(s); }
+};
+
+class RayCaster {
+    public:
+        // Single pass grid traversal. Visits cells in the order the ray enters them
+        // by always stepping across whichever grid line (vertical or horizontal) is nearer.
+        // http://www.cse.yorku.ca/~amana/research/grid.pdf
+        //
+        // Open space is crossed without visiting every cell: the largest empty block around the
+        // ray, from 8x8 up to the whole map, is left in one jump, and empty runs along a row or
+        // column are skipped using the occupancy bits. Cost grows with the number of walls
+        // nearby and the log of the distance.
+        //
+        // direction does not need to be normalised. Distance is returned in multiples of its
+        // length, so a unit direction gives euclidean length and a direction whose component
+        // along the view axis is 1 gives perpendicular (fisheye free) distance.
+        //
+        // maxDistance is a budget in the same units as the returned distance. The ray ends at
+        // the first grid line past it, and misses report maxDistance as their length.
+        // See distanceBudget for picking one.
+        static RayHit cast(const GridView& grid, const Point2D& origin, double dirX, double dirY, double cellSize, double maxDistance) {
+            RayHit result;
+            RayTraversal ray(origin.x() / cellSize, origin.y() / cellSize, dirX, dirY);
+            double maxT = maxDistance / cellSize;
+            int level = 0;  // block level of the last jump, see leaveEmptyBlock
+
+            while (ray.nextT() <= maxT) {
+                result.steps++;
+                // cheap checks first so the common case of stepping through a busy area stays tight
+                bool jumped = grid.blockEmpty(0, ray.cellX, ray.cellY) && leaveEmptyBlock(grid, ray, maxT, level);
+                if (!jumped) {
+                    if (ray.runLength() > 1) {
+                        skipEmptyRun(grid, ray, maxT);
+                    }
+                    ray.step();
+                }
+
+                // padding around the grid is solid so this can't run off the edge,
+                // but only cells inside the grid count as hits
+                if (grid.solid(ray.cellX, ray.cellY)) {
+                    result.hit = grid.inBounds(ray.cellX, ray.cellY);
+                    break;
+                }
+            }
+
+            finish(grid, result, ray, maxT, cellSize);
+            return result;
+        }
+
+        // Same traversal as cast, but open space is crossed using the grid's distance field.
+        // A cell d from the nearest wall sits in an empty (2d - 1) square, so the ray leaves
+        // that square in one jump. Leaps are largest far from walls and shrink to single
+        // steps next to them.
+        static RayHit castDistanceField(const GridView& grid, const Point2D& origin, double dirX, double dirY, double cellSize, double maxDistance) {
+            RayHit result;
+            RayTraversal ray(origin.x() / cellSize, origin.y() / cellSize, dirX, dirY);
+            double maxT = maxDistance / cellSize;
+
+            while (ray.nextT() <= maxT) {
+                result.steps++;
+                int d = grid.distanceToWall(ray.cellX, ray.cellY) - 1;
+                bool jumped = d > 0 && ray.leaveBox(ray.cellX - d, ray.cellX + d, ray.cellY - d, ray.cellY + d, maxT);
+                if (!jumped) {
+                    ray.step();
+                }
+
+                if (grid.solid(ray.cellX, ray.cellY)) {
+                    result.hit = grid.inBounds(ray.cellX, ray.cellY);
+                    break;
+                }
+            }
+
+            finish(grid, result, ray, maxT, cellSize);
+            return result;
+        }
+
+        // Like cast, but records the see-through cells it passes and keeps going until it stops
+        // on a wall, the edge of the grid or the budget, which always takes the last entry.
+        // The last slot is kept for that so a ray always finds what is behind, see-through cells
+        // past the first capacity - 1 are left out.
+        static void castThrough(const GridView& grid, const Point2D& origin, double dirX, double dirY, double cellSize, double maxDistance,
+                                RayHitList& out) {
+            out.count = 0;
+            RayTraversal ray(origin.x() / cellSize, origin.y() / cellSize, dirX, dirY);
+            double maxT = maxDistance / cellSize;
+            int level = 0;  // block level of the last jump, see leaveEmptyBlock
+            int steps = 0;
+            bool stopped = false;
+
+            while (ray.nextT() <= maxT) {
+                steps++;
+                bool jumped = grid.blockEmpty(0, ray.cellX, ray.cellY) && leaveEmptyBlock(grid, ray, maxT, level);
+                if (!jumped) {
+                    if (ray.runLength() > 1) {
+                        skipEmptyRun(grid, ray, maxT);
+                    }
+                    ray.step();
+                }
+
+                if (grid.solid(ray.cellX, ray.cellY)) {
+                    if (!grid.seeThrough(ray.cellX, ray.cellY)) {
+                        stopped = true;
+                        break;
+                    }
+                    if (out.count < RayHitList::capacity - 1) {
+                        RayHit& hit = out.hits[out.count++];
+                        hit = RayHit();
+                        hit.hit = true;
+                        hit.cellX = ray.cellX;
+                        hit.cellY = ray.cellY;
+                        hit.axis = ray.axis;
+                        resolve(hit, ray.originX, ray.originY, dirX, dirY, ray.t, cellSize);
+                    }
+                }
+            }
+
+            RayHit& last = out.hits[out.count++];
+            last = RayHit();
+            last.steps = steps;
+            last.hit = stopped && grid.inBounds(ray.cellX, ray.cellY);
+            if (last.hit) {
+                last.cellX = ray.cellX;
+                last.cellY = ray.cellY;
+                last.axis = ray.axis;
+            }
+            resolve(last, ray.originX, ray.originY, dirX, dirY, stopped ? ray.t : maxT, cellSize);
+        }
+
+        // Single ray through the fixed point traversal, for columns cast one at a time.
+        // castRaysFixed is the whole-screen version.
+        static RayHit castFixed(const GridView& grid, const Point2D& origin, double dirX, double dirY, double cellSize, double maxDistance) {
+            return castPlain<fixed>(grid, origin, dirX, dirY, cellSize, maxDistance);
+        }
+
+        // traverse wrapped up as a RayHit, only converting into Scalar and back at the ends
+        template <typename Scalar, typename Stop = SolidCells>
+        static RayHit castPlain(const GridView& grid, const Point2D& origin, double dirX, double dirY, double cellSize, double maxDistance) {
+            typedef RayScalar<Scalar> S;
+            RayHit result;
+            Scalar t;
+            double originX = origin.x() / cellSize;
+            double originY = origin.y() / cellSize;
+            traverse<Scalar, Stop>(grid, S::fromDouble(originX), S::fromDouble(originY), S::fromDouble(dirX), S::fromDouble(dirY),
+                                   S::fromDouble(maxDistance / cellSize), result, t);
+            resolve(result, originX, originY, dirX, dirY, S::toDouble(t), cellSize);
+            return result;
+        }
+
+        // True if nothing opaque lies between two points, see-through cells don't block sight
+        static bool lineOfSight(const GridView& grid, const Point2D& from, const Point2D& to, double cellSize) {
+            RayHit result;
+            double t;
+            // direction runs the whole way so the budget is 1
+            return !traverse<double, OpaqueCells>(grid, from.x() / cellSize, from.y() / cellSize,
+                                                  (to.x() - from.x()) / cellSize, (to.y() - from.y()) / cellSize, 1.0, result, t);
+        }
+
+        // Plain DDA, built for each arithmetic type (RayScalar) and set of cells that stop
+        // it (SolidCells, OpaqueCells, CellSet) so both are decided at compile time.
+        // Origin and direction are in grid units, t is in multiples of the direction's length.
+        // Fills in hit, cell, axis and steps, t ends at maxT if nothing stopped the ray.
+        // Returns true if it stopped, which includes stopping on the padding.
+        // For fixed there is no division of any kind, grid line spacing comes from Fixed::reciprocal.
+        template <typename Scalar, typename Stop = SolidCells>
+        static bool traverse(const GridView& grid, Scalar originX, Scalar originY, Scalar dirX, Scalar dirY, Scalar maxT,
+                             RayHit& result, Scalar& t) {
+            typedef RayScalar<Scalar> S;
+            int cellX = S::floor(originX);
+            int cellY = S::floor(originY);
+            int stepX = (dirX < 0) ? -1 : 1;
+            int stepY = (dirY < 0) ? -1 : 1;
+            Scalar deltaX = S::reciprocal((dirX < 0) ? -dirX : dirX);
+            Scalar deltaY = S::reciprocal((dirY < 0) ? -dirY : dirY);
+            Scalar fractionX = originX - S::fromInt(cellX);
+            Scalar fractionY = originY - S::fromInt(cellY);
+            Scalar sideX = S::mul((dirX < 0) ? fractionX : S::one - fractionX, deltaX);
+            Scalar sideY = S::mul((dirY < 0) ? fractionY : S::one - fractionY, deltaY);
+            RayHitAxis axis = RayHitAxis::none;
+            bool stopped = false;
+            t = 0;
+
+            // for fixed, sides only grow while they are the nearer one and within maxT, so stay
+            // below maxT + infinity and can't overflow
+            while (std::min(sideX, sideY) <= maxT) {
+                result.steps++;
+                if (sideX < sideY) {
+                    t = sideX;
+                    sideX += deltaX;
+                    cellX += stepX;
+                    axis = RayHitAxis::vertical;
+                } else {
+                    t = sideY;
+                    sideY += deltaY;
+                    cellY += stepY;
+                    axis = RayHitAxis::horizontal;
+                }
+                if (Stop::stops(grid, cellX, cellY)) {
+                    stopped = true;
+                    break;
+                }
+            }
+
+            result.hit = stopped && grid.inBounds(cellX, cellY);
+            if (result.hit) {
+                result.cellX = cellX;
+                result.cellY = cellY;
+                result.axis = axis;
+            }
+            if (!stopped) {
+                t = maxT;
+            }
+            return stopped;
+        }
+
+        // Ray2D wrapped up as a RayHit, direction must be normalised.
+        // Ray2D counts grid lines, so it is given enough to cover maxDistance and anything
+        // it finds further away is dropped.
+        static RayHit castReference(const GridView& grid, const Point2D& origin, double dirX, double dirY, double cellSize, double maxDistance) {
+            RayHit result;
+            // angle 0 points down +y, see Point2D::getAngleTo
+            Ray2D ray(origin, atan2(dirX, dirY), (int) ceil(maxDistance / cellSize) + 1, cellSize, grid);
+            double length = ray.getLength();
+            result.hit = ray.getHit() && length <= maxDistance;
+            result.steps = ray.getSteps();
+            if (result.hit) {
+                result.cellX = (int) floor(ray.getHitPos().x() / cellSize);
+                result.cellY = (int) floor(ray.getHitPos().y() / cellSize);
+                result.axis = ray.getHitAxis();
+            } else if (length > maxDistance) {
+                length = maxDistance;
+            }
+            resolve(result, origin.x() / cellSize, origin.y() / cellSize, dirX, dirY, length / cellSize, cellSize);
+            return result;
+        }
+
+        static RayHit cast(RayKernel kernel, const GridView& grid, const Point2D& origin, double dirX, double dirY, double cellSize, double maxDistance) {
+            if (kernel == RayKernel::distanceFieldKernel) {
+                return castDistanceField(grid, origin, dirX, dirY, cellSize, maxDistance);
+            } else if (kernel == RayKernel::referenceKernel) {
+                return castReference(grid, origin, dirX, dirY, cellSize, maxDistance);
+            } else if (kernel == RayKernel::fixedKernel) {
+                return castFixed(grid, origin, dirX, dirY, cellSize, maxDistance);
+            }
+            return cast(grid, origin, dirX, dirY, cellSize, maxDistance);
+        }
+
+        // Furthest a ray can usefully travel in a map of cellSize cells: the far corner when
+        // fogDistance is 0, otherwise whichever is closer. Rays starting inside the map always
+        // meet a wall or the edge before the far corner.
+        static double distanceBudget(const GridView& grid, double cellSize, double fogDistance = 0) {
+            double corner = sqrt((double) grid.width * grid.width + (double) grid.height * grid.height) * cellSize;
+            return (fogDistance > 0 && fogDistance < corner) ? fogDistance : corner;
+        }
+
+        static const char* getKernelName(RayKernel kernel) {
+            if (kernel == RayKernel::distanceFieldKernel) {
+                return "distance field";
+            } else if (kernel == RayKernel::fixedKernel) {
+                return "fixed";
+            } else if (kernel == RayKernel::referenceKernel) {
+                return "Ray2D";
+            }
+            return "blocks";
+        }
+
+        // Jumps out of the largest empty block around the ray's cell. Expects the level 0 block
+        // to be empty, a block can only be empty if the blocks inside it are.
+        // level is the level of the last jump and is kept between calls: the next block out is
+        // usually the same size, it climbs a level at a time in open space and drops back down
+        // as walls get near. A ray crossing open space n cells wide makes about log n jumps.
+        // Blocks the budget runs out in are stepped down through so the ray still ends near maxT.
+        static bool leaveEmptyBlock(const GridView& grid, RayTraversal& ray, double maxT, int& level) {
+            while (level > 0 && !grid.blockEmpty(level, ray.cellX, ray.cellY)) {
+                level--;
+            }
+            while (level + 1 < grid.blockLevels && grid.blockEmpty(level + 1, ray.cellX, ray.cellY)) {
+                level++;
+            }
+            for (; level >= 0; level--) {
+                int minX, maxX, minY, maxY;
+                GridView::blockRange(level, ray.cellX, minX, maxX);
+                GridView::blockRange(level, ray.cellY, minY, maxY);
+                if (ray.leaveBox(minX, maxX, minY, maxY, maxT)) {
+                    return true;
+                }
+            }
+            level = 0;
+            return false;
+        }
+
+        // While the ray stays in one row (or column) skip the empty cells before the next wall
+        // in it, found a word at a time from the occupancy bits.
+        // Leaves the grid line after the skip within maxT, since the caller steps across it next.
+        static void skipEmptyRun(const GridView& grid, RayTraversal& ray, double maxT) {
+            int run = ray.runLength();
+            if (run <= 1) {
+                return;
+            }
+            if (ray.sideX < ray.sideY) {
+                int budget = (int) std::min((maxT - ray.sideX) / ray.deltaX, (double) run);
+                int skip = std::min(std::min(run, grid.distanceToSolidInRow(ray.cellX, ray.cellY, ray.stepX) - 1), budget);
+                if (skip > 0) {
+                    ray.skipX(skip);
+                }
+            } else {
+                int budget = (int) std::min((maxT - ray.sideY) / ray.deltaY, (double) run);
+                int skip = std::min(std::min(run, grid.distanceToSolidInColumn(ray.cellX, ray.cellY, ray.stepY) - 1), budget);
+                if (skip > 0) {
+                    ray.skipY(skip);
+                }
+            }
+        }
+
+        // Copies a finished traversal into result. Rays that used up their budget
+        // (rather than stopping on a wall or the edge of the grid) end at maxT.
+        static void finish(const GridView& grid, RayHit& result, const RayTraversal& ray, double maxT, double cellSize) {
+            double t = ray.t;
+            if (result.hit) {
+                result.cellX = ray.cellX;
+                result.cellY = ray.cellY;
+                result.axis = ray.axis;
+            } else if (!grid.solid(ray.cellX, ray.cellY)) {
+                t = maxT;
+            }
+            resolve(result, ray.originX, ray.originY, ray.dirX, ray.dirY, t, cellSize);
+        }
+
+        // Fills in the end point, and for hits the face and wall coordinate, of a finished
+        // traversal. Expects hit, cell and axis to be set already. Origin is in grid units.
+        static void resolve(RayHit& result, double originX, double originY, double dirX, double dirY, double t, double cellSize) {
+            double endX = originX + dirX * t;
+            double endY = originY + dirY * t;
+            result.distance = t * cellSize;
+            result.hitX = endX * cellSize;
+            result.hitY = endY * cellSize;
+            if (result.hit) {
+                // wall coordinate runs the same way round every face so textures aren't mirrored
+                if (result.axis == RayHitAxis::vertical) {
+                    result.face = (dirX > 0) ? RayHitFace::leftFace : RayHitFace::rightFace;
+                    result.wallU = endY - floor(endY);
+                    if (dirX < 0) { result.wallU = 1 - result.wallU; }
+                } else {
+                    result.face = (dirY > 0) ? RayHitFace::topFace : RayHitFace::bottomFace;
+                    result.wallU = endX - floor(endX);
+                    if (dirY > 0) { result.wallU = 1 - result.wallU; }
+                }
+                // guard against 1 - 0
+                if (result.wallU >= 1) { result.wallU = 0; }
+            }
+        }
+
+        // Casts columnCount rays from origin through evenly spaced points on the camera plane,
+        // starting at cameraPlane.first and stepping towards cameraPlane.second.
+        // Placing rays through the plane (rather than at even angles) keeps screen slices evenly
+        // sized. https://www.scottsmitelli.com/articles/we-can-fix-your-raycaster/
+        // table is updated for the camera, and only rebuilt when the resolution or field of view
+        // has changed since the caller last passed it in.
+        static void castRays(const GridView& grid, const Point2D& origin, const std::pair<Point2D, Point2D>& cameraPlane,
+                             int columnCount, double cellSize, double maxDistance, ColumnTable& table, RayBatch& out,
+                             RayKernel kernel = RayKernel::blockKernel) {
+            if (kernel == RayKernel::fixedKernel) {
+                castRaysFixed(grid, origin, cameraPlane, columnCount, cellSize, maxDistance, table, out);
+                return;
+            }
+            out.resize(columnCount);
+            table.update(origin, cameraPlane, columnCount);
+            castBand(grid, origin, cameraPlane, table, 0, columnCount, cellSize, maxDistance, out, kernel);
+            out.countSteps();
+        }
+
+        // Casts columns [begin, end) of castRays into out, which must already be resized for
+        // the whole frame and table up to date for it. Bands only write their own columns and
+        // read shared state, so a frame can be split between threads. Steps aren't totalled.
+        static void castBand(const GridView& grid, const Point2D& origin, const std::pair<Point2D, Point2D>& cameraPlane,
+                             const ColumnTable& table, int begin, int end, double cellSize, double maxDistance, RayBatch& out,
+                             RayKernel kernel = RayKernel::blockKernel) {
+            if (kernel == RayKernel::fixedKernel) {
+                castBandFixed(grid, origin, cameraPlane, table, begin, end, cellSize, maxDistance, out);
+                return;
+            }
+            for (int i = begin; i < end; i++) {
+                castColumn(kernel, grid, origin, table, i, cellSize, maxDistance, out);
+            }
+        }
+
+        // Casts one column into out. Kernels are given the column's view direction, whose
+        // component along the view axis is one, so the distance they report is already
+        // perpendicular to the camera plane. The budget is scaled to stay euclidean.
+        // Ray2D only takes angles so is cast along the unit direction and corrected instead.
+        static void castColumn(RayKernel kernel, const GridView& grid, const Point2D& origin, const ColumnTable& table, int i,
+                               double cellSize, double maxDistance, RayBatch& out) {
+            double dirX, dirY;
+            if (kernel == RayKernel::referenceKernel) {
+                table.direction(i, dirX, dirY);
+                RayHit ray = castReference(grid, origin, dirX, dirY, cellSize, maxDistance);
+                out.set(i, ray);
+                out.perpDistance[i] = ray.distance * table.correction(i);
+                return;
+            }
+            table.viewDirection(i, dirX, dirY);
+            RayHit ray = cast(kernel, grid, origin, dirX, dirY, cellSize, maxDistance * table.correction(i));
+            setColumn(table, i, ray, out);
+        }
+
+        // stores a ray cast along a view direction, ray.distance is perpendicular
+        static void setColumn(const ColumnTable& table, int i, const RayHit& ray, RayBatch& out) {
+            out.set(i, ray);
+            out.perpDistance[i] = ray.distance;
+            out.distance[i] = ray.distance * table.viewLength(i);
+        }
+
+        // castRays through the fixed point traversal. Directions are scaled so their component
+        // along the view axis is one, which makes every t a perpendicular distance, and each
+        // column's direction is the last plus a fixed step. The column loop is all integer:
+        // no divides, no square roots and no trig.
+        // The budget is applied along the view axis rather than along each ray.
+        static void castRaysFixed(const GridView& grid, const Point2D& origin, const std::pair<Point2D, Point2D>& cameraPlane,
+                                  int columnCount, double cellSize, double maxDistance, ColumnTable& table, RayBatch& out) {
+            out.resize(columnCount);
+            table.update(origin, cameraPlane, columnCount);
+            castBandFixed(grid, origin, cameraPlane, table, 0, columnCount, cellSize, maxDistance, out);
+            out.countSteps();
+        }
+
+        // columns [begin, end) of castRaysFixed, see castBand. A band starts its direction
+        // begin whole steps along, which is the same integer sum the column loop would reach,
+        // so results don't depend on how the frame is split.
+        static void castBandFixed(const GridView& grid, const Point2D& origin, const std::pair<Point2D, Point2D>& cameraPlane,
+                                  const ColumnTable& table, int begin, int end, double cellSize, double maxDistance, RayBatch& out) {
+            int columnCount = out.count;
+
+            // -- per frame setup, the only floating point --
+            double forwardX = (cameraPlane.first.x() + cameraPlane.second.x()) / 2 - origin.x();
+            double forwardY = (cameraPlane.first.y() + cameraPlane.second.y()) / 2 - origin.y();
+            double scale = 1 / sqrt(forwardX * forwardX + forwardY * forwardY);
+            // directions are stepped with 32 fraction bits, 16 would drift by a few pixels
+            // across the screen
+            int64_t dirXWide = llround((cameraPlane.first.x() - origin.x()) * scale * 4294967296.0);
+            int64_t dirYWide = llround((cameraPlane.first.y() - origin.y()) * scale * 4294967296.0);
+            int64_t dirStepX = llround((cameraPlane.second.x() - cameraPlane.first.x()) * scale / columnCount * 4294967296.0);
+            int64_t dirStepY = llround((cameraPlane.second.y() - cameraPlane.first.y()) * scale / columnCount * 4294967296.0);
+            fixed originX = Fixed::fromDouble(origin.x() / cellSize);
+            fixed originY = Fixed::fromDouble(origin.y() / cellSize);
+            fixed maxT = RayScalar<fixed>::fromDouble(maxDistance / cellSize);
+            dirXWide += dirStepX * begin;
+            dirYWide += dirStepY * begin;
+
+            // -- columns --
+            for (int i = begin; i < end; i++) {
+                fixed dirX = (fixed) ((dirXWide + (1 << 15)) >> 16);
+                fixed dirY = (fixed) ((dirYWide + (1 << 15)) >> 16);
+                RayHit ray;
+                fixed t;
+                traverse<fixed>(grid, originX, originY, dirX, dirY, maxT, ray, t);
+                fixed endX = originX + Fixed::mul(dirX, t);
+                fixed endY = originY + Fixed::mul(dirY, t);
+
+                out.hit[i] = ray.hit;
+                out.axis[i] = ray.axis;
+                out.cellX[i] = ray.cellX;
+                out.cellY[i] = ray.cellY;
+                out.perpDistanceFixed[i] = t;
+                out.steps[i] = ray.steps;
+                // world units for everything else that reads the batch, fixed point can't hold
+                // positions on big maps in world units
+                out.perpDistance[i] = Fixed::toDouble(t) * cellSize;
+                out.hitX[i] = Fixed::toDouble(endX) * cellSize;
+                out.hitY[i] = Fixed::toDouble(endY) * cellSize;
+                fixed wallU = 0;
+                if (ray.hit) {
+                    wallU = (ray.axis == RayHitAxis::vertical) ? endY & Fixed::fractionMask : endX & Fixed::fractionMask;
+                    if ((ray.axis == RayHitAxis::vertical) ? dirX < 0 : dirY > 0) { wallU = (Fixed::one - wallU) & Fixed::fractionMask; }
+                }
+                out.wallU[i] = Fixed::toDouble(wallU);
+
+                dirXWide += dirStepX;
+                dirYWide += dirStepY;
+            }
+
+            // euclidean lengths aren't needed by the fixed renderer, fill them in afterwards
+            // for anything else reading the batch
+            for (int i = begin; i < end; i++) {
+                out.distance[i] = out.perpDistance[i] * table.viewLength(i);
+            }
+        }
+
+        // Rebuilds a batch for a camera that has only turned since previous was cast from
+        // previousPlane, same origin, map and limits. Returns the number of columns recast.
+        //
+        // A new column whose direction falls between two neighbouring old columns that hit the
+        // same face of the same cell must hit that face too. The gap between them is thinner than
+        // a cell, so no other wall can fit inside without one of them hitting it first, and it is
+        // no further than the further of the two so the budget can't cut it short. Those columns
+        // are intersected with the face directly. The rest, including columns turned into view,
+        // are cast as usual.
+        static int reprojectRays(const GridView& grid, const Point2D& origin, const std::pair<Point2D, Point2D>& cameraPlane,
+                                 const std::pair<Point2D, Point2D>& previousPlane, const RayBatch& previous,
+                                 int columnCount, double cellSize, double maxDistance, ColumnTable& table, RayBatch& out,
+                                 RayKernel kernel = RayKernel::blockKernel) {
+            out.resize(columnCount);
+            table.update(origin, cameraPlane, columnCount);
+            int recast = reprojectBand(grid, origin, table, previousPlane, previous, 0, columnCount, cellSize, maxDistance, out, kernel);
+            out.countSteps();
+            return recast;
+        }
+
+        // columns [begin, end) of reprojectRays, see castBand
+        static int reprojectBand(const GridView& grid, const Point2D& origin, const ColumnTable& table,
+                                 const std::pair<Point2D, Point2D>& previousPlane, const RayBatch& previous,
+                                 int begin, int end, double cellSize, double maxDistance, RayBatch& out, RayKernel kernel = RayKernel::blockKernel) {
+            int recast = 0;
+            // old columns sit at previousLeft + s * previousStep for whole s
+            double previousLeftX = previousPlane.first.x() - origin.x();
+            double previousLeftY = previousPlane.first.y() - origin.y();
+            double previousStepX = (previousPlane.second.x() - previousPlane.first.x()) / previous.count;
+            double previousStepY = (previousPlane.second.y() - previousPlane.first.y()) / previous.count;
+            double previousForwardX = (previousPlane.first.x() + previousPlane.second.x()) / 2 - origin.x();
+            double previousForwardY = (previousPlane.first.y() + previousPlane.second.y()) / 2 - origin.y();
+
+            for (int i = begin; i < end; i++) {
+                double dirX, dirY;
+                table.viewDirection(i, dirX, dirY);
+
+                RayHit ray;
+                // where the ray crosses the old camera plane, only counts in front of the old view
+                double cross = dirX * previousStepY - dirY * previousStepX;
+                bool reused = false;
+                if (cross != 0 && dirX * previousForwardX + dirY * previousForwardY > 0) {
+                    double s = (previousLeftX * dirY - previousLeftY * dirX) / cross;
+                    if (s >= 0 && s < previous.count - 1) {
+                        int column = (int) s;
+                        reused = reprojectColumn(previous, column, column + 1, origin, dirX, dirY, cellSize, ray);
+                    }
+                }
+                if (reused) {
+                    setColumn(table, i, ray, out);
+                } else {
+                    castColumn(kernel, grid, origin, table, i, cellSize, maxDistance, out);
+                    recast++;
+                }
+            }
+            return recast;
+        }
+
+        // Intersects the ray with the face hit by both old columns a and b, if they hit the same one
+        static bool reprojectColumn(const RayBatch& previous, int a, int b, const Point2D& origin, double dirX, double dirY,
+                                    double cellSize, RayHit& result) {
+            if (!previous.hit[a] || !previous.hit[b] || previous.axis[a] != previous.axis[b]
+                || previous.cellX[a] != previous.cellX[b] || previous.cellY[a] != previous.cellY[b]) {
+                return false;
+            }
+            double originX = origin.x() / cellSize;
+            double originY = origin.y() / cellSize;
+            int cellX = previous.cellX[a];
+            int cellY = previous.cellY[a];
+            double t;
+            if (previous.axis[a] == RayHitAxis::vertical) {
+                if (dirX == 0) {
+                    return false;
+                }
+                t = (((dirX > 0) ? cellX : cellX + 1) - originX) / dirX;
+            } else {
+                if (dirY == 0) {
+                    return false;
+                }
+                t = (((dirY > 0) ? cellY : cellY + 1) - originY) / dirY;
+            }
+            if (t < 0) {
+                return false;
+            }
+            result.hit = true;
+            result.cellX = cellX;
+            result.cellY = cellY;
+            result.axis = previous.axis[a];
+            resolve(result, originX, originY, dirX, dirY, t, cellSize);
+            return true;
+        }
+};
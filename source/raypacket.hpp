@@ -0,0 +1,307 @@
+#pragma once
+
+#include <math.h>
+#include <utility>
+#include "point.hpp"
+#include "grid.hpp"
+#include "raycaster.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RAYPACKET_X86
+#include <immintrin.h>
+#endif
+
+// Instruction set used to step rays in packets
+enum PacketMode {
+    scalarPacket,  // one ray at a time through RayCaster::cast
+    sse4Packet,  // 4 rays per step
+    avx2Packet  // 8 rays per step
+};
+
+// Steps neighbouring rays through the grid in lock-step. Adjacent screen columns follow
+// nearly the same path so lanes tend to finish together, and finished lanes are masked off
+// until the whole packet is done.
+// Lanes step in single precision, setup and results are double precision like RayCaster.
+// The widest instruction set the CPU supports is picked at runtime, anything else
+// (including non x86 machines) uses the scalar kernel.
+class RayPacket {
+    public:
+        static const PacketMode getMode() {
+            if (!modeChosen) {
+                setMode(getSupportedMode());
+            }
+            return mode;
+        }
+
+        // requested mode is lowered to the best the CPU supports
+        static void setMode(PacketMode requested) {
+            PacketMode supported = getSupportedMode();
+            mode = (requested > supported) ? supported : requested;
+            modeChosen = true;
+        }
+
+        static const char* getModeName(PacketMode packetMode) {
+            if (packetMode == PacketMode::avx2Packet) {
+                return "avx2";
+            } else if (packetMode == PacketMode::sse4Packet) {
+                return "sse4.1";
+            }
+            return "scalar";
+        }
+
+        static const PacketMode getSupportedMode() {
+#ifdef RAYPACKET_X86
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2")) {
+                return PacketMode::avx2Packet;
+            }
+            if (__builtin_cpu_supports("sse4.1")) {
+                return PacketMode::sse4Packet;
+            }
+#endif
+            return PacketMode::scalarPacket;
+        }
+
+        // Drop in replacement for RayCaster::castRays
+        static void castRays(const GridView& grid, const Point2D& origin, const std::pair<Point2D, Point2D>& cameraPlane,
+                             int columnCount, double cellSize, double maxDistance, ColumnTable& table, RayBatch& out) {
+            out.resize(columnCount);
+            table.update(origin, cameraPlane, columnCount);
+            castBand(grid, origin, table, 0, columnCount, cellSize, maxDistance, out);
+            out.countSteps();
+        }
+
+        // Columns [begin, end) of castRays, see RayCaster::castBand. Bands that start on a
+        // multiple of the packet width pack the same way as the whole frame.
+        // Call getMode before splitting a frame between threads, it picks the mode the first time.
+        static void castBand(const GridView& grid, const Point2D& origin, const ColumnTable& table, int begin, int end,
+                             double cellSize, double maxDistance, RayBatch& out) {
+            Packet packet;
+            packet.originX = origin.x() / cellSize;
+            packet.originY = origin.y() / cellSize;
+            packet.cellX = (int) floor(packet.originX);
+            packet.cellY = (int) floor(packet.originY);
+            double maxT = maxDistance / cellSize;
+
+            int width = 1;
+            PacketMode packetMode = getMode();
+            if (packetMode == PacketMode::avx2Packet) {
+                width = 8;
+            } else if (packetMode == PacketMode::sse4Packet) {
+                width = 4;
+            }
+
+            int i = begin;
+            // -- packets --
+            for (; width > 1 && i + width <= end; i += width) {
+                // view directions, so t is the perpendicular distance and each lane's budget
+                // is scaled to stay euclidean
+                for (int lane = 0; lane < width; lane++) {
+                    double dirX, dirY;
+                    table.viewDirection(i + lane, dirX, dirY);
+                    setupLane(packet, lane, dirX, dirY);
+                    packet.maxT[lane] = (float) (maxT * table.correction(i + lane));
+                }
+#ifdef RAYPACKET_X86
+                if (packetMode == PacketMode::avx2Packet) {
+                    traverseAVX2(grid, packet);
+                } else {
+                    traverseSSE4(grid, packet);
+                }
+#endif
+                for (int lane = 0; lane < width; lane++) {
+                    RayHit ray;
+                    // lanes also stop on the padding, which isn't a hit
+                    ray.hit = packet.hit[lane] != 0 && grid.inBounds(packet.hitCellX[lane], packet.hitCellY[lane]);
+                    if (ray.hit) {
+                        ray.cellX = packet.hitCellX[lane];
+                        ray.cellY = packet.hitCellY[lane];
+                        ray.axis = (packet.hitAxisX[lane] != 0) ? RayHitAxis::vertical : RayHitAxis::horizontal;
+                    }
+                    // lanes that ran out of budget end at it, like RayCaster::finish
+                    double t = (packet.hit[lane] != 0) ? packet.t[lane] : packet.maxT[lane];
+                    RayCaster::resolve(ray, packet.originX, packet.originY, packet.dirX[lane], packet.dirY[lane], t, cellSize);
+                    RayCaster::setColumn(table, i + lane, ray, out);
+                }
+                out.steps[i] = packet.steps;  // lanes step together, the packet's steps go on its first column
+            }
+
+            // -- leftover columns --
+            for (; i < end; i++) {
+                RayCaster::castColumn(RayKernel::blockKernel, grid, origin, table, i, cellSize, maxDistance, out);
+            }
+        }
+
+    private:
+        static inline PacketMode mode = PacketMode::scalarPacket;
+        static inline bool modeChosen = false;
+
+        // Per lane state in and out of the traversal, in grid units.
+        // All lanes share an origin, so only direction dependent values are per lane.
+        struct Packet {
+            double originX, originY;
+            int cellX, cellY;  // cell containing the origin
+            alignas(32) float maxT[8];  // distance budget per lane, in multiples of its direction
+
+            double dirX[8], dirY[8];
+            alignas(32) float deltaX[8];
+            alignas(32) float deltaY[8];
+            alignas(32) float sideX[8];
+            alignas(32) float sideY[8];
+            alignas(32) int stepX[8];
+            alignas(32) int stepY[8];
+
+            // results
+            int steps;
+            alignas(32) float t[8];
+            alignas(32) int hit[8];  // stopped on a wall or the padding
+            alignas(32) int hitCellX[8];
+            alignas(32) int hitCellY[8];
+            alignas(32) int hitAxisX[8];  // non zero when a vertical grid line was crossed last
+        };
+
+        // same setup as RayCaster::cast, done in double precision before narrowing
+        static void setupLane(Packet& packet, int lane, double dirX, double dirY) {
+            const double infinity = 1e30;
+            double deltaX = (dirX != 0) ? fabs(1 / dirX) : infinity;
+            double deltaY = (dirY != 0) ? fabs(1 / dirY) : infinity;
+            packet.dirX[lane] = dirX;
+            packet.dirY[lane] = dirY;
+            packet.deltaX[lane] = (float) deltaX;
+            packet.deltaY[lane] = (float) deltaY;
+            packet.stepX[lane] = (dirX < 0) ? -1 : 1;
+            packet.stepY[lane] = (dirY < 0) ? -1 : 1;
+            packet.sideX[lane] = (float) ((dirX < 0) ? (packet.originX - packet.cellX) * deltaX : (packet.cellX + 1 - packet.originX) * deltaX);
+            packet.sideY[lane] = (float) ((dirY < 0) ? (packet.originY - packet.cellY) * deltaY : (packet.cellY + 1 - packet.originY) * deltaY);
+        }
+
+        // Grid lookups stay scalar, bits are cheaper to test than to gather.
+        // Returns a bitmask of lanes that entered a wall or the padding around the grid.
+        static int lookupLanes(const GridView& grid, int activeLanes, const int* cellX, const int* cellY) {
+            int hitLanes = 0;
+            for (int lane = 0; activeLanes != 0; lane++, activeLanes >>= 1) {
+                if ((activeLanes & 1) && grid.solid(cellX[lane], cellY[lane])) {
+                    hitLanes |= 1 << lane;
+                }
+            }
+            return hitLanes;
+        }
+
+#ifdef RAYPACKET_X86
+        __attribute__((target("avx2")))
+        static void traverseAVX2(const GridView& grid, Packet& packet) {
+            __m256 sideX = _mm256_load_ps(packet.sideX);
+            __m256 sideY = _mm256_load_ps(packet.sideY);
+            __m256 deltaX = _mm256_load_ps(packet.deltaX);
+            __m256 deltaY = _mm256_load_ps(packet.deltaY);
+            __m256i stepX = _mm256_load_si256((const __m256i*) packet.stepX);
+            __m256i stepY = _mm256_load_si256((const __m256i*) packet.stepY);
+            __m256i cellX = _mm256_set1_epi32(packet.cellX);
+            __m256i cellY = _mm256_set1_epi32(packet.cellY);
+            __m256 maxT = _mm256_load_ps(packet.maxT);
+            __m256 t = _mm256_setzero_ps();
+            __m256i axisX = _mm256_setzero_si256();
+            __m256i hit = _mm256_setzero_si256();
+            alignas(32) int laneCellX[8];
+            alignas(32) int laneCellY[8];
+            __m256i laneBits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+
+            packet.steps = 0;
+            // lanes with no grid line inside the budget never start
+            __m256i active = _mm256_castps_si256(_mm256_cmp_ps(_mm256_min_ps(sideX, sideY), maxT, _CMP_LE_OQ));
+            int activeLanes = _mm256_movemask_ps(_mm256_castsi256_ps(active));
+            while (activeLanes != 0) {
+                // step each active lane across its nearer grid line
+                __m256i nearerX = _mm256_castps_si256(_mm256_cmp_ps(sideX, sideY, _CMP_LT_OQ));
+                __m256i moveX = _mm256_and_si256(nearerX, active);
+                __m256i moveY = _mm256_andnot_si256(nearerX, active);
+                __m256 moveXf = _mm256_castsi256_ps(moveX);
+                __m256 moveYf = _mm256_castsi256_ps(moveY);
+
+                t = _mm256_blendv_ps(t, sideX, moveXf);
+                t = _mm256_blendv_ps(t, sideY, moveYf);
+                sideX = _mm256_add_ps(sideX, _mm256_and_ps(deltaX, moveXf));
+                sideY = _mm256_add_ps(sideY, _mm256_and_ps(deltaY, moveYf));
+                cellX = _mm256_add_epi32(cellX, _mm256_and_si256(stepX, moveX));
+                cellY = _mm256_add_epi32(cellY, _mm256_and_si256(stepY, moveY));
+                axisX = _mm256_or_si256(_mm256_andnot_si256(active, axisX), moveX);
+                packet.steps += __builtin_popcount(activeLanes);
+
+                _mm256_store_si256((__m256i*) laneCellX, cellX);
+                _mm256_store_si256((__m256i*) laneCellY, cellY);
+                // expand the hit bitmask back out to one lane mask per ray
+                __m256i hitBits = _mm256_set1_epi32(lookupLanes(grid, activeLanes, laneCellX, laneCellY));
+                __m256i newHit = _mm256_cmpeq_epi32(_mm256_and_si256(hitBits, laneBits), laneBits);
+                hit = _mm256_or_si256(hit, newHit);
+
+                // retire lanes that hit or whose next grid line is past the budget
+                __m256i spent = _mm256_castps_si256(_mm256_cmp_ps(_mm256_min_ps(sideX, sideY), maxT, _CMP_GT_OQ));
+                __m256i done = _mm256_or_si256(newHit, spent);
+                active = _mm256_andnot_si256(done, active);
+                activeLanes = _mm256_movemask_ps(_mm256_castsi256_ps(active));
+            }
+
+            _mm256_store_ps(packet.t, t);
+            _mm256_store_si256((__m256i*) packet.hit, hit);
+            _mm256_store_si256((__m256i*) packet.hitCellX, cellX);
+            _mm256_store_si256((__m256i*) packet.hitCellY, cellY);
+            _mm256_store_si256((__m256i*) packet.hitAxisX, axisX);
+        }
+
+        __attribute__((target("sse4.1")))
+        static void traverseSSE4(const GridView& grid, Packet& packet) {
+            __m128 sideX = _mm_load_ps(packet.sideX);
+            __m128 sideY = _mm_load_ps(packet.sideY);
+            __m128 deltaX = _mm_load_ps(packet.deltaX);
+            __m128 deltaY = _mm_load_ps(packet.deltaY);
+            __m128i stepX = _mm_load_si128((const __m128i*) packet.stepX);
+            __m128i stepY = _mm_load_si128((const __m128i*) packet.stepY);
+            __m128i cellX = _mm_set1_epi32(packet.cellX);
+            __m128i cellY = _mm_set1_epi32(packet.cellY);
+            __m128 maxT = _mm_load_ps(packet.maxT);
+            __m128 t = _mm_setzero_ps();
+            __m128i axisX = _mm_setzero_si128();
+            __m128i hit = _mm_setzero_si128();
+            alignas(16) int laneCellX[4];
+            alignas(16) int laneCellY[4];
+            __m128i laneBits = _mm_setr_epi32(1, 2, 4, 8);
+
+            packet.steps = 0;
+            __m128i active = _mm_castps_si128(_mm_cmple_ps(_mm_min_ps(sideX, sideY), maxT));
+            int activeLanes = _mm_movemask_ps(_mm_castsi128_ps(active));
+            while (activeLanes != 0) {
+                __m128i nearerX = _mm_castps_si128(_mm_cmplt_ps(sideX, sideY));
+                __m128i moveX = _mm_and_si128(nearerX, active);
+                __m128i moveY = _mm_andnot_si128(nearerX, active);
+                __m128 moveXf = _mm_castsi128_ps(moveX);
+                __m128 moveYf = _mm_castsi128_ps(moveY);
+
+                t = _mm_blendv_ps(t, sideX, moveXf);
+                t = _mm_blendv_ps(t, sideY, moveYf);
+                sideX = _mm_add_ps(sideX, _mm_and_ps(deltaX, moveXf));
+                sideY = _mm_add_ps(sideY, _mm_and_ps(deltaY, moveYf));
+                cellX = _mm_add_epi32(cellX, _mm_and_si128(stepX, moveX));
+                cellY = _mm_add_epi32(cellY, _mm_and_si128(stepY, moveY));
+                axisX = _mm_or_si128(_mm_andnot_si128(active, axisX), moveX);
+                packet.steps += __builtin_popcount(activeLanes);
+
+                _mm_store_si128((__m128i*) laneCellX, cellX);
+                _mm_store_si128((__m128i*) laneCellY, cellY);
+                __m128i hitBits = _mm_set1_epi32(lookupLanes(grid, activeLanes, laneCellX, laneCellY));
+                __m128i newHit = _mm_cmpeq_epi32(_mm_and_si128(hitBits, laneBits), laneBits);
+                hit = _mm_or_si128(hit, newHit);
+
+                __m128i spent = _mm_castps_si128(_mm_cmpgt_ps(_mm_min_ps(sideX, sideY), maxT));
+                __m128i done = _mm_or_si128(newHit, spent);
+                active = _mm_andnot_si128(done, active);
+                activeLanes = _mm_movemask_ps(_mm_castsi128_ps(active));
+            }
+
+            _mm_store_ps(packet.t, t);
+            _mm_store_si128((__m128i*) packet.hit, hit);
+            _mm_store_si128((__m128i*) packet.hitCellX, cellX);
+            _mm_store_si128((__m128i*) packet.hitCellY, cellY);
+            _mm_store_si128((__m128i*) packet.hitAxisX, axisX);
+        }
+#endif
+};
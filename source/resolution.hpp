@@ -0,0 +1,102 @@
+#pragma once
+
+#include <array>
+#include <algorithm>
+#include <math.h>
+
+// Picks the size 3D frames are drawn at from how long recent frames took to draw, so a machine
+// that can't fill every pixel in time draws fewer and Window::presentRender stretches them
+// rather than missing frames.
+// Times are averaged over the last few frames so one slow frame (a room being generated)
+// changes nothing, and after each change the average starts again so the new size is judged
+// on frames drawn at it. The scale drops a step once frames take most of the budget, and only
+// goes back up when frames at the next size up would still be well inside it, so it settles
+// rather than flipping between two sizes.
+class ResolutionController {
+    public:
+        // targetSeconds is the drawing time allowed a frame, fullWidth x fullHeight the largest size
+        ResolutionController(double targetSeconds, int fullWidth, int fullHeight) {
+            this->targetSeconds = targetSeconds;
+            this->fullWidth = fullWidth;
+            this->fullHeight = fullHeight;
+        }
+
+        // adds how long the last frame took to draw, which may change the size
+        void addFrame(double seconds) {
+            if (!enabled) {
+                return;
+            }
+            total += seconds - times[next];
+            times[next] = seconds;
+            next = (next + 1) % sampleCount;
+            filled = std::min(filled + 1, sampleCount);
+            if (filled < sampleCount) {
+                return;
+            }
+
+            double average = total / sampleCount;
+            if (average > targetSeconds * lowerAbove && step < stepCount) {
+                setStep(step + 1);
+            } else if (step > 0) {
+                // drawing time grows with the number of pixels, so with the square of the scale
+                double ratio = getScale(step - 1) / getScale(step);
+                if (average * ratio * ratio < targetSeconds * raiseBelow) {
+                    setStep(step - 1);
+                }
+            }
+        }
+
+        // disabled draws at the full size
+        void setEnabled(bool enabled) {
+            this->enabled = enabled;
+            setStep(0);
+        }
+
+        const bool getEnabled() const {
+            return enabled;
+        }
+
+        // fraction of the full width and height drawn
+        const double getScale() const {
+            return getScale(step);
+        }
+
+        // kept a multiple of 8 so column tiles and 8 wide spans line up the same at every size
+        const int getWidth() const {
+            return std::max((int) lround(fullWidth * getScale() / 8) * 8, 8);
+        }
+
+        // kept even so the horizon stays in the middle
+        const int getHeight() const {
+            return std::max((int) lround(fullHeight * getScale() / 2) * 2, 2);
+        }
+
+    private:
+        static inline const int sampleCount = 30;  // half a second at 60 fps
+        static inline const int stepCount = 6;  // down to 40% each way, 16% of the pixels
+        static inline const double stepSize = 0.1;
+        static inline const double lowerAbove = 0.9;  // of the budget
+        static inline const double raiseBelow = 0.75;
+
+        double targetSeconds;
+        int fullWidth;
+        int fullHeight;
+        bool enabled = true;
+        int step = 0;  // steps down from the full size
+        std::array<double, sampleCount> times = {};  // last sampleCount frames, oldest at next
+        int next = 0;
+        int filled = 0;
+        double total = 0;
+
+        static double getScale(int step) {
+            return 1 - step * stepSize;
+        }
+
+        void setStep(int step) {
+            this->step = step;
+            times.fill(0);
+            total = 0;
+            filled = 0;
+            next = 0;
+        }
+};
@@ -6,17 +6,29 @@
 #include <queue>
 #include <unordered_map>
 #include <string>
+#include <limits>
 
 #include "random.hpp"
 #include "utilities.hpp"
 #include "window.hpp"
 #include "ray.hpp"
+#include "raycaster.hpp"
+#include "raypacket.hpp"
+#include "raycache.hpp"
+#include "threadpool.hpp"
+#include "texture.hpp"
+#include "floorcaster.hpp"
+#include "sprite.hpp"
+#include "grid.hpp"
 #include "point.hpp"
 #include "input.hpp"
 #include "player.hpp"
 
 #define EMPTY '.'
 #define WALL '#'
+#define WINDOW '='
+#define GRATE '+'
+#define GLASS '~'
 #define PLAYER 'P'
 
 class Room {
@@ -54,8 +66,8 @@ class Room {
             }
         }
 
-        const std::vector<std::vector<char>> getMap() {
-            return map;
+        const GridView getMap() const {
+            return map.view();
         }
 
         Room* update(double dt) {
@@ -63,7 +75,7 @@ class Room {
             getInput();
 
             // -- update --
-            player.update(dt, map, wallSize);
+            player.update(dt, map.view(), wallSize);
 
             // if a player is on an exit, enter new room
             // get pointer to neighbour room corresponding to exit and add new room if required
@@ -95,8 +107,40 @@ class Room {
             return x >= 0 && y >= 0 && x < width && y < height;
         }
 
+        // threads frames are drawn with, 1 draws on the calling thread only and 0 uses one per core
+        static void setThreadCount(int count) {
+            threadCount = count;
+            ThreadPool::shared().setThreadCount(count);
+        }
+
+        static const bool getDrawMode2D() {
+            return drawMode2D;
+        }
+
+        static const RayKernel getRayKernel() {
+            return rayKernel;
+        }
+
+        const double getMaxDistance() const {
+            return maxDistance;
+        }
+
+        // grid cells visited by all rays in the last frame drawn, for tuning the distance budget
+        const int getFrameSteps() const {
+            return rays.totalSteps;
+        }
+
+        const int getSpriteCount() const {
+            return (int) sprites.size();
+        }
+
+        const double getStepsPerRay() const {
+            return (rays.count > 0) ? (double) rays.totalSteps / rays.count : 0;
+        }
+
         void draw(Window& window) {
             if (drawMode2D) {
+                window.clear();
                 draw2D(window);
             } else {
                 draw3D(window);
@@ -106,7 +150,11 @@ class Room {
     private:
         Random random;
         static inline bool drawMode2D = true;
-        const int maxDof = 8;
+        static inline RayKernel rayKernel = RayKernel::blockKernel;
+        const double fogDistance = 0;  // rays stop this far away when set, otherwise at the far corner of the room
+        double maxDistance = 0;  // distance budget for rays, worked out when the room is generated
+        const Uint32 ceilingColour = Colours::black.ARGB8888();
+        const Uint32 floorColour = Colours::black.ARGB8888();
 
         int maxWidth;
         int maxHeight;
@@ -117,10 +165,39 @@ class Room {
 
         // need to store rooms so they arent freed once update stackframe pops
         std::vector<Point2D> exits;
-        std::vector<std::vector<char>> map;
+        Grid map;
         std::unordered_map<int, Room*> exitRoomsMap;  // exit index: room pointer
         std::unordered_map<Point2D, char, PointHasher> exitWallMap;  // exit: wall tblr
         Player player;
+        RayBatch rays;  // reused every frame to avoid reallocating
+        ColumnTable columns;  // screen column directions rays are cast along, rebuilt when the render width changes
+        RayCache rayCache;  // pose rays was last cast from, skips casting while nothing moves
+        RayBatch previousRays;  // last frame's results while reprojecting them into rays
+        std::vector<RayHitList> seeThroughHits;  // per column, only filled where the first hit can be seen through
+        RayPose seeThroughPose;  // pose seeThroughHits were cast for
+        static inline bool reprojectTurns = true;
+        static inline TextureCache textures;  // shared by every room
+        static inline const MipTexture* wallTexture = NULL;  // loaded on the first 3D frame, NULL if it couldn't be
+        static inline bool texturedWalls = true;
+        static inline std::unique_ptr<FlatTexture> floorTexture;  // wallTexture for floors and ceilings
+        static inline bool castFloors = true;
+        bool floorPass = false;  // this frame's floors and ceilings are drawn by FloorCaster after the walls
+        std::vector<int> ceilingEnds;  // per column, where its ceiling stops when floorPass
+        std::vector<int> floorStarts;  // per column, where its floor starts
+        std::vector<int> floorShades;  // per floor row from the horizon down, sized with the screen
+        std::vector<int> ceilingShades;
+        int floorShadesHeight = 0;  // render height the shades were worked out for
+        std::vector<Sprite> sprites;  // enemies and pickups, placed when the room is generated
+        SpriteRenderer spriteRenderer;
+        std::vector<float> wallDepths;  // per column, distance along the view axis to the wall drawn in it
+        static inline int threadCount = 0;  // set from the command line, 0 is one per core
+
+        // how castRays fills rays
+        enum CastPath {
+            kernelCast,  // RayCaster with rayKernel
+            packetCast,  // RayPacket
+            reprojectCast  // last frame's rays turned, for turning on the spot
+        };
 
         Point2D randomPointOnWall(const char& wall) {
             // exclude corners
@@ -153,43 +230,55 @@ class Room {
             do {
                 generateRoom(entranceWall);
             } while (!roomTraversable());
+            map.refreshDistances();
+            placeSprites();
+            maxDistance = RayCaster::distanceBudget(map.view(), wallSize, fogDistance);
             // convert from grid coord space to window coord space
             player.set(player.x() * wallSize, player.y() * wallSize);
         }
 
         // generate a random, potentially invalid room layout
         void generateRoom(const char& entranceWall='n') {
-            map.clear();
             exits.clear();
             width = random.between(3, maxWidth);
             height = random.between(3, maxHeight);
+            map.resize(width, height, EMPTY);
 
             // -- create random map --
             for (int y = 0; y < height; y++) {
-                map.push_back(std::vector<char>());
                 for (int x = 0; x < width; x++) {
                     // create walls
                     if (y == 0 || y == height - 1 || x == 0 || x == width - 1) {
-                        map[y].push_back(WALL);
+                        map.set(x, y, WALL);
                     // create random internal walls
                     } else {
-                        map[y].push_back((random.random(4) == 0) ? WALL : EMPTY);
+                        map.set(x, y, (random.random(4) == 0) ? WALL : EMPTY);
                     }
                 }
             }
 
             // -- fill in holes --
             for (int y = 0; y < height; y++) {
-                for (int x = 0; x < height; x++) {
+                for (int x = 0; x < width; x++) {
                     Point2D p = Point2D(x, y);
                     int wallNeighbours = 0;
                     for (auto n : p.getCardinalNeighbours()) {
-                        if (normalisedPointInRoom(n) && map[n.y()][n.x()] == WALL) {
+                        if (normalisedPointInRoom(n) && map.at(n.x(), n.y()) == WALL) {
                             wallNeighbours++;
                         }
                     }
                     if (wallNeighbours >= 3) {
-                        map[p.y()][p.x()] = WALL;
+                        map.set(p.x(), p.y(), WALL);
+                    }
+                }
+            }
+
+            // -- swap some internal walls for see-through ones --
+            const char seeThroughCells[] = {WINDOW, GRATE, GLASS};
+            for (int y = 1; y < height - 1; y++) {
+                for (int x = 1; x < width - 1; x++) {
+                    if (map.at(x, y) == WALL && random.random(6) == 0) {
+                        map.set(x, y, seeThroughCells[random.random(3)]);
                     }
                 }
             }
@@ -205,7 +294,7 @@ class Room {
                 exits.push_back(entrance);
                 exitWallMap[entrance] = entranceWall;
             }
-            map[player.y()][player.x()] = EMPTY;
+            map.set(player.x(), player.y(), EMPTY);
 
             // -- generate exits --
             int numExits = random.random(3) + 1;  // must be at least one exit
@@ -220,12 +309,29 @@ class Room {
                 char wall = exitDirections[exitTypeIndex];
                 popAllOfValue(exitDirections, wall);  // remove to avoid duplicates
                 Point2D exitPoint = randomPointOnWall(wall);
-                map[exitPoint.y()][exitPoint.x()] = EMPTY;  // update map
+                map.set(exitPoint.x(), exitPoint.y(), EMPTY);  // update map
                 exits.push_back(exitPoint);
                 exitWallMap[exitPoint] = wall;
             }
         }
 
+        // scatters enemies and pickups over the empty cells, not on the player or an exit
+        void placeSprites() {
+            sprites.clear();
+            for (int y = 1; y < height - 1; y++) {
+                for (int x = 1; x < width - 1; x++) {
+                    if (map.at(x, y) != EMPTY || Point2D(x, y) == player || random.random(3) != 0) {
+                        continue;
+                    }
+                    Sprite sprite;
+                    sprite.x = (x + random.between(20, 80) / 100.0) * wallSize;
+                    sprite.y = (y + random.between(20, 80) / 100.0) * wallSize;
+                    sprite.kind = (random.random(3) == 0) ? SpriteKind::enemySprite : SpriteKind::pickupSprite;
+                    sprites.push_back(sprite);
+                }
+            }
+        }
+
         // verify room layout is traversable with bfs to exits
         bool roomTraversable() {
             std::queue<Point2D> visitQueue;
@@ -241,7 +347,7 @@ class Room {
                 }
 
                 for (auto n : p.getCardinalNeighbours()) {
-                    if (normalisedPointInRoom(n) && map[n.y()][n.x()] == EMPTY && !visited[n]) {
+                    if (normalisedPointInRoom(n) && map.at(n.x(), n.y()) == EMPTY && !visited[n]) {
                         visitQueue.push(n);
                         visited[n] = true;
                     }
@@ -262,20 +368,93 @@ class Room {
             if (keydowns[SDLK_1]) {
                 drawMode2D = !drawMode2D;
             }
+            // cycle ray kernels to compare them on the same room
+            if (keydowns[SDLK_2]) {
+                rayKernel = (RayKernel) ((rayKernel + 1) % (RayKernel::fixedKernel + 1));
+                std::cout << "ray kernel: " << RayCaster::getKernelName(rayKernel) << '\n';
+            }
+            if (keydowns[SDLK_3]) {
+                reprojectTurns = !reprojectTurns;
+                std::cout << "reproject turns: " << (reprojectTurns ? "on" : "off") << '\n';
+            }
+            // single threaded to compare against
+            if (keydowns[SDLK_5]) {
+                ThreadPool& pool = ThreadPool::shared();
+                pool.setThreadCount((pool.getThreadCount() == 1) ? threadCount : 1);
+                std::cout << "render threads: " << pool.getThreadCount() << '\n';
+            }
+            if (keydowns[SDLK_6]) {
+                texturedWalls = !texturedWalls;
+                std::cout << "textured walls: " << (texturedWalls ? "on" : "off") << '\n';
+            }
+            if (keydowns[SDLK_7]) {
+                castFloors = !castFloors;
+                std::cout << "textured floors: " << (castFloors ? "on" : "off") << " (" << FloorCaster::getModeName(FloorCaster::getMode()) << ")\n";
+            }
+        }
+
+        // fills rays for a pose the cache missed
+        void castRays(const GridView& grid, const RayPose& pose, const std::pair<Point2D, Point2D>& playerCamera, bool packets=false) {
+            CastPath path = prepareCast(pose, packets);
+            columns.update(player, playerCamera, pose.columnCount);
+            castBand(grid, path, playerCamera, 0, pose.columnCount);
+            finishCast(pose);
+        }
+
+        // Picks how rays for a pose the cache missed are cast and sizes rays for them. Columns
+        // are then cast with castBand, in bands from any thread, and finishCast once they're all done.
+        CastPath prepareCast(const RayPose& pose, bool packets) {
+            CastPath path = CastPath::kernelCast;
+            // turning on the spot, reuse last frame's hits for columns still in view
+            // (the fixed point kernel always recasts so its results don't depend on the last frame)
+            if (reprojectTurns && rayKernel != RayKernel::fixedKernel && rayCache.canReproject(pose)) {
+                std::swap(rays, previousRays);
+                path = CastPath::reprojectCast;
+            // packets only step cell by cell so other kernels are cast a ray at a time
+            } else if (packets && rayKernel == RayKernel::blockKernel) {
+                RayPacket::getMode();  // chosen the first time it's asked for, not from inside a band
+                path = CastPath::packetCast;
+            }
+            rays.resize(pose.columnCount);
+            return path;
+        }
+
+        void castBand(const GridView& grid, CastPath path, const std::pair<Point2D, Point2D>& playerCamera, int begin, int end) {
+            if (path == CastPath::reprojectCast) {
+                RayCaster::reprojectBand(grid, player, columns, rayCache.getPose().getCameraPlane(), previousRays,
+                                         begin, end, wallSize, maxDistance, rays, rayKernel);
+            } else if (path == CastPath::packetCast) {
+                RayPacket::castBand(grid, player, columns, begin, end, wallSize, maxDistance, rays);
+            } else {
+                RayCaster::castBand(grid, player, playerCamera, columns, begin, end, wallSize, maxDistance, rays, rayKernel);
+            }
+        }
+
+        void finishCast(const RayPose& pose) {
+            rays.countSteps();
+            rayCache.store(pose);
         }
 
         void draw2D(Window& window) {
+            GridView grid = map.view();
             SDL_Rect tile = {0, 0, wallSize, wallSize};
-            for (int y = 0; y < map.size(); y++) {
+            for (int y = 0; y < grid.height; y++) {
                 tile.y = y * wallSize;
-                for (int x = 0; x < map[y].size(); x++) {
+                for (int x = 0; x < grid.width; x++) {
                     tile.x = x * wallSize;
-                    if (map[y][x] == WALL) {
+                    if (grid.at(x, y) == WALL) {
                         window.renderRect(tile, Colours::grey);
+                    } else if (GridView::seeThroughCell(grid.at(x, y))) {
+                        window.renderRect(tile, Colours::cyan);
                     }
                 }
             }
 
+            for (const Sprite& sprite : sprites) {
+                SDL_Rect mark = {(int) sprite.x - 3, (int) sprite.y - 3, 6, 6};
+                window.renderRect(mark, (sprite.kind == SpriteKind::enemySprite) ? Colours::red : Colours::yellow);
+            }
+
             player.draw2D(window);
             
             // find offset for a single slice of camera plane
@@ -285,67 +464,301 @@ class Room {
             Point2D lerpOffset = Point2D((playerCamera.second.x() - playerCamera.first.x()) * lerpIncrement,
                                          (playerCamera.second.y() - playerCamera.first.y()) * lerpIncrement);
             // debug raycasts
-            for (int x = 0; x < window.screenWidth; x++) {
-                double rayAngle = player.getAngleTo(cameraCastPoint);
-                Ray2D ray = Ray2D(player, rayAngle, maxDof, wallSize, map);
+            RayPose pose(grid, player, player.getRotRad(), playerCamera, window.screenWidth, wallSize, maxDistance, rayKernel);
+            if (!rayCache.lookup(pose)) {
+                castRays(grid, pose, playerCamera);
+            }
+            for (int x = 0; x < rays.count; x++) {
+                Point2D hitPos(rays.hitX[x], rays.hitY[x]);
                 window.renderLine(cameraCastPoint, cameraCastPoint, Colours::green);
-                if (ray.getHit()) {
-                    window.renderLine(cameraCastPoint, ray.getHitPos(), Colours::magenta);
+                if (rays.hit[x]) {
+                    window.renderLine(cameraCastPoint, hitPos, Colours::magenta);
                 } else {
-                    window.renderLine(cameraCastPoint, ray.getHitPos(), Colours::yellow);
+                    window.renderLine(cameraCastPoint, hitPos, Colours::yellow);
                 }
                 cameraCastPoint = cameraCastPoint + lerpOffset;
             }
         }
 
+        // Columns don't depend on each other, so casting and drawing them is split into tiles
+        // of columns on the shared ThreadPool. Anything shared is set up first on this thread,
+        // tiles only write their own columns.
         void draw3D(Window& window) {
+            GridView grid = map.view();
             const int w = 1;  // pixels per slice
-            int y, h;
-            
-            // find offset for a single slice of camera plane
-            // prevents outer fisheye by placing rays through camera slices (mapping to screen slices)
-            // rather than even radial increments which don't properly align with screen slices
-            // https://www.scottsmitelli.com/articles/we-can-fix-your-raycaster/
+            if (texturedWalls && wallTexture == NULL) {
+                wallTexture = textures.get("assets/Grass.png");
+                texturedWalls = wallTexture != NULL;  // flat shaded if it won't load
+                if (wallTexture != NULL) {
+                    floorTexture.reset(new FlatTexture(*wallTexture, 7));
+                }
+            }
+            floorPass = castFloors && floorTexture != NULL;
+            if (floorPass) {
+                prepareFloors(window);
+            }
+
+            // one ray per screen slice, placed through the camera plane
             std::pair<Point2D, Point2D> playerCamera = player.getCameraPlane();
-            Point2D cameraCastPoint(playerCamera.first);
-            double lerpIncrement = (double) 1 / (window.screenWidth / w);
-            Point2D lerpOffset = Point2D((playerCamera.second.x() - playerCamera.first.x()) * lerpIncrement,
-                                         (playerCamera.second.y() - playerCamera.first.y()) * lerpIncrement);
+            RayPose pose(grid, player, player.getRotRad(), playerCamera, window.getRenderWidth() / w, wallSize, maxDistance, rayKernel);
+            columns.update(player, playerCamera, pose.columnCount);
+            bool cast = !rayCache.lookup(pose);
+            CastPath path = cast ? prepareCast(pose, true) : CastPath::kernelCast;
+            bool castThrough = pose != seeThroughPose;
+            if ((int) seeThroughHits.size() < pose.columnCount) {
+                seeThroughHits.resize(pose.columnCount);
+            }
+            wallDepths.resize(pose.columnCount);
+            spriteRenderer.prepare(sprites, columns, player, window.getRenderHeight(), wallSize);
+            // every pixel gets drawn, marking them up front stops the tiles racing to
+            window.markDirty(0, window.getRenderWidth(), 0, window.getRenderHeight());
+
+            // tiles a packet wide so packets line up the same however the frame is split, and
+            // small enough that stealing can even out a frame that's mostly near wall on one side
+            ThreadPool::shared().forTiles(pose.columnCount, 8, [&](int begin, int end) {
+                if (cast) {
+                    castBand(grid, path, playerCamera, begin, end);
+                }
+                if (castThrough) {
+                    castSeeThrough(grid, begin, end);
+                }
+                for (int i = begin; i < end; i++) {
+                    drawRay(window, grid, i, i * w);
+                    if (!floorPass) {
+                        drawInFront(window, grid, i, i * w);
+                    }
+                }
+            });
+
+            // Floors and ceilings a row at a time around the walls, then see-through slices
+            // and sprites over the top. Rows are tiled in 8s like columns, pairs of rows near the horizon
+            // are mostly wall and quick so stealing evens them out.
+            if (floorPass) {
+                FloorFrame frame;
+                frame.originX = player.x() / wallSize;
+                frame.originY = player.y() / wallSize;
+                double nextX, nextY;
+                columns.viewDirection(0, frame.leftX, frame.leftY);
+                columns.viewDirection(std::min(1, pose.columnCount - 1), nextX, nextY);
+                frame.stepX = (nextX - frame.leftX) / w;
+                frame.stepY = (nextY - frame.leftY) / w;
+                frame.width = pose.columnCount * w;
+                frame.height = window.getRenderHeight();
+                frame.ceilingEnds = ceilingEnds.data();
+                frame.floorStarts = floorStarts.data();
+                frame.floorShades = floorShades.data();
+                frame.ceilingShades = ceilingShades.data();
+                frame.texture = floorTexture.get();
+                ThreadPool::shared().forTiles((int) floorShades.size(), 8, [&](int begin, int end) {
+                    FloorCaster::drawRows(window, frame, begin, end);
+                });
+                ThreadPool::shared().forTiles(pose.columnCount, 8, [&](int begin, int end) {
+                    for (int i = begin; i < end; i++) {
+                        drawInFront(window, grid, i, i * w);
+                    }
+                });
+            }
+
+            if (cast) {
+                finishCast(pose);
+            }
+            seeThroughPose = pose;
+        }
+
+        // Sizes the per column and per row arrays the floor pass reads, they only change with the render size.
+        // Rows are shaded like a wall whose foot is on that row, the ceiling a bit darker.
+        void prepareFloors(Window& window) {
+            int height = window.getRenderHeight();
+            ceilingEnds.resize(window.getRenderWidth());
+            floorStarts.resize(window.getRenderWidth());
+            if (floorShadesHeight != height) {
+                int rows = height - height / 2;
+                floorShades.resize(rows);
+                ceilingShades.resize(rows);
+                for (int row = 0; row < rows; row++) {
+                    double fromHorizon = FloorCaster::rowOffset(row, height);
+                    // projectSlice's brightness for the wall, whatever the render size
+                    int value = std::min((int) (255 * 2 * fromHorizon * Window::screenHeight / height / wallSize) + 30, 200);
+                    floorShades[row] = value * 256 / 200;
+                    ceilingShades[row] = floorShades[row] * 3 / 4;
+                }
+                floorShadesHeight = height;
+            }
+            FloorCaster::getMode();  // chosen here rather than from inside a tile
+        }
 
-            // loop through screen slices
-            for (int x = 0; x < window.screenWidth; x += w) {
-                double rayAngle = player.getAngleTo(cameraCastPoint);
-                Ray2D ray = Ray2D(player, rayAngle, maxDof, wallSize, map);
-                double rayLength = ray.getLength();
-
-                // allowing for curved viewing surface (prevent aspect of fisheye)
-                // https://stackoverflow.com/questions/66591163/how-do-i-fix-the-warped-perspective-in-my-raycaster
-                double angleDifference = wrapRadAngle(player.getRotRad() - rayAngle);
-                rayLength *= cos(angleDifference);
-                if (rayLength < 1) {
-                    rayLength = 1;
+        // Draws the back wall of column i of rays at x and records its depth for sprites. Every
+        // column is written top to bottom, so the frame isn't cleared first. See-through slices
+        // and sprites in front of the wall are left to drawInFront, after the floor pass if there is one.
+        void drawRay(Window& window, const GridView& grid, int i, int x) {
+            if (!rays.hit[i]) {
+                wallDepths[i] = std::numeric_limits<float>::infinity();
+                drawBackground(window, x);
+                return;
+            }
+            if (!grid.seeThrough(rays.cellX[i], rays.cellY[i])) {
+                if (rayKernel == RayKernel::fixedKernel) {
+                    int h, value;
+                    wallDepths[i] = (float) ((double) rays.perpDistanceFixed[i] * wallSize / Fixed::one);
+                    projectSliceFixed(window, rays.perpDistanceFixed[i], h, value);
+                    drawColumn(window, x, h, value, rays.axis[i], rays.wallU[i], WALL);
+                } else {
+                    wallDepths[i] = (float) rays.perpDistance[i];
+                    drawSlice(window, x, rays.perpDistance[i], rays.axis[i], rays.wallU[i], WALL);
                 }
+                return;
+            }
 
-                h = std::min(wallSize * window.screenHeight / rayLength, (double)window.screenHeight);  // cap height to screen height
-                y = (window.screenHeight - h) / 2;
+            // first hit can be seen through, the last is whatever stopped the ray behind it
+            const RayHitList& hits = seeThroughHits[i];
+            const RayHit& back = hits.hits[hits.count - 1];
+            if (back.hit) {
+                wallDepths[i] = (float) back.distance;
+                drawSlice(window, x, back.distance, back.axis, back.wallU, grid.at(back.cellX, back.cellY));
+            } else {
+                wallDepths[i] = std::numeric_limits<float>::infinity();
+                drawBackground(window, x);  // nothing solid behind to fill the column
+            }
+        }
 
-                int value = (int) (255 * window.screenHeight / rayLength / wallSize);
-                // value adjustments and capping
-                value += 30;
-                if (value > 200) { value = 200; }
-                if (ray.getHitAxis() == RayHitAxis::horizontal) { value -= 20; }
-                if (value < 0) { value = 0; }
-                Colour colour = {value, value, value, value};
+        // See-through slices and sprites in front of column i's back wall, back to front so
+        // nearer ones cover further ones. The sprites between each pair of slices are drawn
+        // before the nearer slice, so one stood behind a grate is behind its bars.
+        void drawInFront(Window& window, const GridView& grid, int i, int x) {
+            float farDepth = wallDepths[i];
+            if (rays.hit[i] && grid.seeThrough(rays.cellX[i], rays.cellY[i])) {
+                const RayHitList& hits = seeThroughHits[i];
+                for (int h = hits.count - 2; h >= 0; h--) {
+                    const RayHit& hit = hits.hits[h];
+                    if (hit.hit) {
+                        spriteRenderer.drawColumn(window, i, x, (float) hit.distance, farDepth);
+                        drawSlice(window, x, hit.distance, hit.axis, hit.wallU, grid.at(hit.cellX, hit.cellY));
+                        farDepth = (float) hit.distance;
+                    }
+                }
+            }
+            spriteRenderer.drawColumn(window, i, x, 0, farDepth);
+        }
+
+        // Recasts columns [begin, end) whose first hit can be seen through, carrying on past it.
+        // Cast along view directions like castRays so hit distances are perpendicular.
+        // Storage is kept between frames so this doesn't allocate once the screen size is settled.
+        void castSeeThrough(const GridView& grid, int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                if (rays.hit[i] && grid.seeThrough(rays.cellX[i], rays.cellY[i])) {
+                    double dirX, dirY;
+                    columns.viewDirection(i, dirX, dirY);
+                    RayCaster::castThrough(grid, player, dirX, dirY, wallSize, maxDistance * columns.correction(i), seeThroughHits[i]);
+                }
+            }
+        }
+
+        // draws one column of a wall rayLength away along the view axis
+        void drawSlice(Window& window, int x, double rayLength, RayHitAxis axis, double wallU, char cell) {
+            int h, value;
+            projectSlice(window, rayLength, h, value);
+            drawColumn(window, x, h, value, axis, wallU, cell);
+        }
+
+        // slice height and brightness for a wall rayLength away
+        void projectSlice(Window& window, double rayLength, int& h, int& value) {
+            // distance along the view axis rather than euclidean so walls don't fisheye
+            // https://stackoverflow.com/questions/66591163/how-do-i-fix-the-warped-perspective-in-my-raycaster
+            if (rayLength < 1) {
+                rayLength = 1;
+            }
+
+            // not capped to the screen, spans clip themselves and textures need the full height
+            h = (int) (wallSize * window.getRenderHeight() / rayLength);
+            // from the window's height rather than the render size so brightness doesn't change with it
+            value = (int) (255 * Window::screenHeight / rayLength / wallSize);
+        }
+
+        // projectSlice for a 16.16 distance in cells from the fixed point kernel,
+        // 1 / distance comes from the reciprocal table so there's no divide by distance
+        void projectSliceFixed(Window& window, fixed perpDistance, int& h, int& value) {
+            const fixed nearest = Fixed::one / wallSize;  // one world unit, same clamp as projectSlice
+            int64_t inverse = Fixed::reciprocal(std::max(perpDistance, nearest));
+            int64_t height = (window.getRenderHeight() * inverse) >> Fixed::fractionBits;
+
+            h = (int) height;
+            value = (int) (255 * ((Window::screenHeight * inverse) >> Fixed::fractionBits) / (wallSize * wallSize));
+        }
+
+        // Wall texture column wallU stretched over h pixels from y, with the ceiling above and the
+        // floor below. The mip level is picked from h and v steps through it in 16.16.
+        // Brightness is the flat colour's value as a fraction of its cap.
+        void drawTexturedWall(Window& window, int x, int y, int h, int value, double wallU) {
+            int level = wallTexture->levelFor(h);
+            int textureWidth = wallTexture->getWidth(level);
+            int textureHeight = wallTexture->getHeight(level);
+            int u = std::min((int) (wallU * textureWidth), textureWidth - 1);
+            Sint32 vStep = (Sint32) (((int64_t) textureHeight << 16) / h);
+            if (!floorPass) {
+                window.fillColumn(x, 0, y, ceilingColour);
+            }
+            window.fillColumnTextured(x, y, y + h, wallTexture->column(level, u), 0, vStep, value * 256 / 200);
+            if (!floorPass) {
+                window.fillColumn(x, y + h, window.getRenderHeight(), floorColour);
+            }
+        }
 
-                // render ray slice a vertical pixel at a time
-                if (ray.getHit()) {
-                    for (int yOffset = 0; yOffset < h; yOffset++) {
-                        Point2D pixel = {x, y + yOffset};
-                        window.renderPixel(pixel, colour);
+        // ceiling and floor meeting at the horizon, for columns with no wall behind them
+        void drawBackground(Window& window, int x) {
+            int horizon = window.getRenderHeight() / 2;
+            if (floorPass) {
+                setWallSpan(window, x, horizon, horizon);
+            } else {
+                window.fillColumnBands(x, horizon, horizon, ceilingColour, 0, floorColour);
+            }
+        }
+
+        // leaves rows above yStart in column x to the floor pass's ceiling and from yEnd down to its floor
+        void setWallSpan(Window& window, int x, int yStart, int yEnd) {
+            int ceilingEnd = std::clamp(yStart, 0, window.getRenderHeight());
+            ceilingEnds[x] = ceilingEnd;
+            floorStarts[x] = std::clamp(yEnd, ceilingEnd, window.getRenderHeight());
+        }
+
+        // Draws a column h pixels high of the given cell type, blending see-through ones over
+        // whatever is already behind them. Walls are always furthest back so fill the whole
+        // column with their ceiling and floor, or leave them to the floor pass.
+        void drawColumn(Window& window, int x, int h, int value, RayHitAxis axis, double wallU, char cell) {
+            int y = (window.getRenderHeight() - h) / 2;
+
+            // value adjustments and capping
+            value += 30;
+            if (value > 200) { value = 200; }
+            if (axis == RayHitAxis::horizontal) { value -= 20; }
+            if (value < 0) { value = 0; }
+
+            // render ray slice as spans down the column
+            if (cell == WALL && floorPass) {
+                setWallSpan(window, x, y, y + h);
+            }
+            if (cell == WALL && texturedWalls && wallTexture != NULL && h > 0) {
+                drawTexturedWall(window, x, y, h, value, wallU);
+            } else if (cell == WALL && floorPass) {
+                Colour colour = {value, value, value, value};
+                window.fillColumn(x, y, y + h, colour.ARGB8888());
+            } else if (cell == WALL) {
+                Colour colour = {value, value, value, value};
+                window.fillColumnBands(x, y, y + h, ceilingColour, colour.ARGB8888(), floorColour);
+            } else if (cell == GRATE) {
+                // solid bars with gaps between, in wall space so they scale with distance
+                Colour colour = {value / 2, value / 2, value / 2, 255};
+                if ((int) (wallU * 16) % 4 == 0) {
+                    window.fillColumn(x, y, y + h, colour.ARGB8888());
+                } else {
+                    // horizontal bars are the rows where yOffset * 16 / h is a multiple of 4
+                    for (int bar = 0; bar < 16; bar += 4) {
+                        window.fillColumn(x, y + (bar * h + 15) / 16, y + ((bar + 1) * h + 15) / 16, colour.ARGB8888());
                     }
                 }
-                
-                cameraCastPoint = cameraCastPoint + lerpOffset;  // move to next slice of camera plane
+            } else {
+                // windows are a faint tint, glass is thicker
+                Colour colour = (cell == WINDOW) ? Colour(value / 2, value, value, 70) : Colour(value / 3, value, value / 2, 150);
+                window.blendColumn(x, y, y + h, colour);
             }
         }
 };
@@ -0,0 +1,275 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "window.hpp"
+#include "columntable.hpp"
+#include "point.hpp"
+
+// Column-major ARGB image with see-through texels (no alpha), and for each column the run of
+// rows with anything in so strips can skip the empty ends
+class SpriteImage {
+    public:
+        // paint(u, v) gives the texel at the centre of each texel, u and v in [0, 1)
+        template <typename Paint>
+        SpriteImage(int width, int height, const Paint& paint) {
+            this->width = width;
+            this->height = height;
+            texels.resize(width * height);
+            firstRows.resize(width);
+            endRows.resize(width);
+            for (int x = 0; x < width; x++) {
+                firstRows[x] = height;
+                endRows[x] = 0;
+                for (int y = 0; y < height; y++) {
+                    Uint32 texel = paint((x + 0.5) / width, (y + 0.5) / height);
+                    texels[x * height + y] = texel;
+                    if (texel & 0xFF000000) {
+                        firstRows[x] = std::min(firstRows[x], y);
+                        endRows[x] = y + 1;
+                    }
+                }
+            }
+        }
+
+        const int getWidth() const {
+            return width;
+        }
+
+        const int getHeight() const {
+            return height;
+        }
+
+        // column u top to bottom
+        const Uint32* column(int u) const {
+            return &texels[u * height];
+        }
+
+        // rows [firstRow, endRow) of column u hold every opaque texel, empty when firstRow >= endRow
+        const int firstRow(int u) const {
+            return firstRows[u];
+        }
+
+        const int endRow(int u) const {
+            return endRows[u];
+        }
+
+    private:
+        int width;
+        int height;
+        std::vector<Uint32> texels;
+        std::vector<int> firstRows;
+        std::vector<int> endRows;
+};
+
+enum SpriteKind {
+    enemySprite,
+    pickupSprite
+};
+
+// something stood on the floor of a room, drawn facing the camera
+struct Sprite {
+    double x, y;  // world position of its foot
+    SpriteKind kind;
+};
+
+// Draws sprites over a 3D frame as vertical strips, one per screen column they cover.
+// prepare projects them for the frame, sorts the ones in view back to front and files them
+// under the tiles of columns they cover. drawColumn then draws a column's strips between two
+// depths, so a column with see-through slices can have the sprites behind each slice drawn
+// before it and the ones in front after, and sprites behind the wall are skipped without
+// touching any pixels. Storage is kept between frames so once a room's sprites have been seen
+// nothing is allocated.
+class SpriteRenderer {
+    public:
+        // world size of each kind, in cells
+        static double getWidth(SpriteKind kind) {
+            return (kind == SpriteKind::enemySprite) ? 0.6 : 0.3;
+        }
+
+        static double getHeight(SpriteKind kind) {
+            return (kind == SpriteKind::enemySprite) ? 0.8 : 0.3;
+        }
+
+        static const SpriteImage& getImage(SpriteKind kind) {
+            // made up rather than loaded, there are no sprite assets yet
+            static const SpriteImage enemy(32, 32, [](double u, double v) -> Uint32 {
+                double dx = (u - 0.5) / 0.45;
+                double dy = (v - 0.55) / 0.45;
+                if (dx * dx + dy * dy > 1) {
+                    return 0;
+                }
+                // two eyes
+                double ex = fabs(u - 0.5) - 0.15;
+                double ey = v - 0.4;
+                if (ex * ex + ey * ey < 0.006) {
+                    return 0xFFFFFFE0;
+                }
+                return 0xFFB02020 + ((Uint32) (v * 64) << 8);
+            });
+            static const SpriteImage pickup(16, 16, [](double u, double v) -> Uint32 {
+                return (fabs(u - 0.5) + fabs(v - 0.5) < 0.5) ? 0xFFF0D030 : 0;
+            });
+            return (kind == SpriteKind::enemySprite) ? enemy : pickup;
+        }
+
+        // Projects sprites through columns (already updated for this frame) and sorts the ones
+        // in view. Call once a frame on the drawing thread, before any drawColumn.
+        void prepare(const std::vector<Sprite>& sprites, const ColumnTable& columns, const Point2D& origin, int renderHeight, int cellSize) {
+            visible.clear();
+            // room for every sprite up front, so walking into view of more doesn't reallocate
+            visible.reserve(sprites.size());
+            order.reserve(sprites.size());
+            scratch.reserve(sprites.size());
+            columnCount = columns.getColumnCount();
+            const double nearest = cellSize * 0.2;  // nearer than this fills the screen, like walls clamp their distance
+            for (const Sprite& sprite : sprites) {
+                double depth, column;
+                columns.project(sprite.x - origin.x(), sprite.y - origin.y(), depth, column);
+                if (depth < nearest) {
+                    continue;
+                }
+                Projected projected;
+                projected.image = &getImage(sprite.kind);
+                projected.depth = (float) depth;
+                projected.width = getWidth(sprite.kind) * cellSize * columns.columnsPerUnit() / depth;
+                projected.left = column - projected.width / 2;
+                // column i is drawn from the ray through fractional column i exactly
+                projected.first = (int) std::max(ceil(projected.left), 0.0);
+                projected.last = (int) std::min(ceil(projected.left + projected.width), (double) columnCount);
+                if (projected.first >= projected.last) {
+                    continue;
+                }
+                // stood on the floor where a wall this far away would meet it, same as drawColumn
+                double wallHeight = cellSize * renderHeight / depth;
+                projected.height = getHeight(sprite.kind) * cellSize * renderHeight / depth;
+                projected.top = (renderHeight + wallHeight) / 2 - projected.height;
+                int value = std::min((int) (255 * Window::screenHeight / depth / cellSize) + 30, 200);  // as projectSlice
+                projected.shade = value * 256 / 200;
+                visible.push_back(projected);
+            }
+            sortBackToFront();
+            fileInTiles();
+        }
+
+        // sprites in view last prepare
+        const int getVisibleCount() const {
+            return (int) visible.size();
+        }
+
+        // Draws the strips in column i of every sprite in view at least nearDepth and less than
+        // farDepth along the view axis, back to front, at x. Columns don't share anything they
+        // write so can be drawn from different threads.
+        void drawColumn(Window& window, int i, int x, float nearDepth, float farDepth) const {
+            int tile = i / tileWidth;
+            for (int k = tileStarts[tile]; k < tileStarts[tile + 1]; k++) {
+                const Projected& sprite = visible[tileSprites[k]];
+                if (i < sprite.first || i >= sprite.last || sprite.depth < nearDepth || sprite.depth >= farDepth) {
+                    continue;
+                }
+                const SpriteImage& image = *sprite.image;
+                int imageWidth = image.getWidth();
+                int imageHeight = image.getHeight();
+                int u = std::min((int) ((i - sprite.left) / sprite.width * imageWidth), imageWidth - 1);
+                int firstRow = image.firstRow(u);
+                int endRow = image.endRow(u);
+                if (firstRow >= endRow) {
+                    continue;
+                }
+                // only as many rows as stay inside the opaque run, stepping vStep at a time
+                Sint32 vStep = std::max((Sint32) ((int64_t) imageHeight * 65536 / sprite.height), 1);
+                int y = (int) (sprite.top + firstRow * sprite.height / imageHeight);
+                int rows = (int) ((((int64_t) (endRow - firstRow) << 16) + vStep - 1) / vStep);
+                window.fillColumnMasked(x, y, y + rows, image.column(u), firstRow << 16, vStep, sprite.shade);
+            }
+        }
+
+    private:
+        // a sprite in view this frame, in screen space
+        struct Projected {
+            const SpriteImage* image;
+            float depth;  // along the view axis
+            double left;  // fractional column of its left edge
+            double width;  // in columns
+            int first, last;  // screen columns [first, last) it's drawn in
+            double top;  // row of its top edge
+            double height;  // in rows
+            int shade;  // out of 256
+        };
+
+        static inline const int tileWidth = 8;  // columns a sprite list covers
+
+        int columnCount = 0;
+        std::vector<Projected> visible;
+        std::vector<uint64_t> order;  // depth key in the top half, index into visible in the bottom
+        std::vector<uint64_t> scratch;
+        std::vector<int> tileStarts;  // per tile of columns, where its sprites start in tileSprites
+        std::vector<uint32_t> tileSprites;  // indices into visible, each tile's back to front
+
+        // Least significant digit radix sort on the depth, a byte a pass. Depths are positive
+        // floats, whose bits order the same way as the values, inverted so the furthest comes first.
+        // Linear in the number of sprites, and passes where every key shares the byte are skipped,
+        // which for depths in one room is usually the top one.
+        void sortBackToFront() {
+            int count = (int) visible.size();
+            order.resize(count);
+            scratch.resize(count);
+            int counts[4][256] = {};
+            for (int i = 0; i < count; i++) {
+                uint32_t bits;
+                memcpy(&bits, &visible[i].depth, sizeof(bits));
+                uint32_t key = ~bits;
+                order[i] = ((uint64_t) key << 32) | (uint32_t) i;
+                for (int pass = 0; pass < 4; pass++) {
+                    counts[pass][(key >> (pass * 8)) & 0xFF]++;
+                }
+            }
+            for (int pass = 0; pass < 4; pass++) {
+                int shift = 32 + pass * 8;
+                if (count == 0 || counts[pass][(order[0] >> shift) & 0xFF] == count) {
+                    continue;
+                }
+                int offsets[256];
+                int offset = 0;
+                for (int digit = 0; digit < 256; digit++) {
+                    offsets[digit] = offset;
+                    offset += counts[pass][digit];
+                }
+                for (int i = 0; i < count; i++) {
+                    scratch[offsets[(order[i] >> shift) & 0xFF]++] = order[i];
+                }
+                order.swap(scratch);
+            }
+        }
+
+        // Lists each tile's sprites in draw order, so a column only looks through the few that
+        // could cover it. Counted first and then filled so the lists share one array.
+        void fileInTiles() {
+            int tileCount = (columnCount + tileWidth - 1) / tileWidth;
+            tileStarts.assign(tileCount + 1, 0);
+            for (uint64_t key : order) {
+                const Projected& sprite = visible[(uint32_t) key];
+                for (int tile = sprite.first / tileWidth; tile <= (sprite.last - 1) / tileWidth; tile++) {
+                    tileStarts[tile + 1]++;
+                }
+            }
+            for (int tile = 0; tile < tileCount; tile++) {
+                tileStarts[tile + 1] += tileStarts[tile];
+            }
+            tileSprites.resize(tileStarts[tileCount]);
+            for (uint64_t key : order) {
+                const Projected& sprite = visible[(uint32_t) key];
+                for (int tile = sprite.first / tileWidth; tile <= (sprite.last - 1) / tileWidth; tile++) {
+                    tileSprites[tileStarts[tile]++] = (uint32_t) key;
+                }
+            }
+            // filling moved each start on to the next tile's
+            for (int tile = tileCount; tile > 0; tile--) {
+                tileStarts[tile] = tileStarts[tile - 1];
+            }
+            tileStarts[0] = 0;
+        }
+};
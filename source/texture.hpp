@@ -0,0 +1,198 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <algorithm>
+#include "../include/SDL2/SDL.h"
+#include "../include/SDL2/SDL_image.h"
+
+// mean of four ARGB8888 texels, opaque
+inline Uint32 averageTexels(Uint32 a, Uint32 b, Uint32 c, Uint32 d) {
+    int r = 0, g = 0, blue = 0;
+    for (Uint32 texel : {a, b, c, d}) {
+        r += (texel >> 16) & 0xFF;
+        g += (texel >> 8) & 0xFF;
+        blue += texel & 0xFF;
+    }
+    return 0xFF000000 | (Uint32) (((r + 2) / 4 << 16) + ((g + 2) / 4 << 8) + (blue + 2) / 4);
+}
+
+// An image for drawing walls a column at a time, with a chain of half size copies (mipmaps).
+// Texels are stored column-major so a wall slice reads one contiguous strip, and the copy is
+// picked from the slice's height so a strip is never much longer than the slice it fills.
+// That keeps the texels a column loop touches to a few cache lines however far away the
+// wall is, where sampling the full size image for a distant wall strides through all of it.
+class MipTexture {
+    public:
+        // texels are ARGB8888 rows, pitch pixels apart. Alpha is dropped, walls are opaque.
+        MipTexture(const Uint32* texels, int width, int height, int pitch) {
+            Level base;
+            base.width = width;
+            base.height = height;
+            base.texels.resize(width * height);
+            for (int x = 0; x < width; x++) {
+                for (int y = 0; y < height; y++) {
+                    base.texels[x * height + y] = texels[y * pitch + x] | 0xFF000000;
+                }
+            }
+            levels.push_back(base);
+            while (levels.back().width > 1 || levels.back().height > 1) {
+                levels.push_back(halve(levels.back()));
+            }
+        }
+
+        const int getLevelCount() const {
+            return (int) levels.size();
+        }
+
+        const int getWidth(int level) const {
+            return levels[level].width;
+        }
+
+        const int getHeight(int level) const {
+            return levels[level].height;
+        }
+
+        // smallest level still at least h texels high, so each pixel of a slice h pixels high
+        // steps down at most two texels
+        int levelFor(int h) const {
+            int level = 0;
+            while (level + 1 < (int) levels.size() && levels[level + 1].height >= h) {
+                level++;
+            }
+            return level;
+        }
+
+        // column u of a level, top to bottom
+        const Uint32* column(int level, int u) const {
+            const Level& l = levels[level];
+            return &l.texels[u * l.height];
+        }
+
+    private:
+        struct Level {
+            int width;
+            int height;
+            std::vector<Uint32> texels;  // column-major
+        };
+        std::vector<Level> levels;
+
+        // averages 2x2 blocks, odd edges average with themselves
+        static Level halve(const Level& source) {
+            Level half;
+            half.width = std::max(source.width / 2, 1);
+            half.height = std::max(source.height / 2, 1);
+            half.texels.resize(half.width * half.height);
+            for (int x = 0; x < half.width; x++) {
+                int x0 = std::min(x * 2, source.width - 1);
+                int x1 = std::min(x * 2 + 1, source.width - 1);
+                for (int y = 0; y < half.height; y++) {
+                    int y0 = std::min(y * 2, source.height - 1);
+                    int y1 = std::min(y * 2 + 1, source.height - 1);
+                    half.texels[x * half.height + y] = averageTexels(source.texels[x0 * source.height + y0], source.texels[x0 * source.height + y1],
+                                                                      source.texels[x1 * source.height + y0], source.texels[x1 * source.height + y1]);
+                }
+            }
+            return half;
+        }
+};
+
+// A square image for floors and ceilings, which are drawn a row of the screen at a time.
+// Kept row-major with half size copies like MipTexture, and a power of two wide so coordinates
+// wrap round a cell with a mask rather than a divide.
+class FlatTexture {
+    public:
+        // source's full size image resampled to 2^sizeBits square
+        FlatTexture(const MipTexture& source, int sizeBits) {
+            int size = 1 << sizeBits;
+            Level base;
+            base.sizeBits = sizeBits;
+            base.texels.resize(size * size);
+            for (int y = 0; y < size; y++) {
+                for (int x = 0; x < size; x++) {
+                    base.texels[y * size + x] = source.column(0, x * source.getWidth(0) / size)[y * source.getHeight(0) / size];
+                }
+            }
+            levels.push_back(base);
+            while (levels.back().sizeBits > 0) {
+                const Level& previous = levels.back();
+                int previousSize = 1 << previous.sizeBits;
+                Level half;
+                half.sizeBits = previous.sizeBits - 1;
+                int halfSize = 1 << half.sizeBits;
+                half.texels.resize(halfSize * halfSize);
+                for (int y = 0; y < halfSize; y++) {
+                    const Uint32* row = &previous.texels[y * 2 * previousSize];
+                    for (int x = 0; x < halfSize; x++) {
+                        half.texels[y * halfSize + x] = averageTexels(row[x * 2], row[x * 2 + 1], row[previousSize + x * 2], row[previousSize + x * 2 + 1]);
+                    }
+                }
+                levels.push_back(half);
+            }
+        }
+
+        const int getLevelCount() const {
+            return (int) levels.size();
+        }
+
+        // log2 of the width and height of a level
+        const int getSizeBits(int level) const {
+            return levels[level].sizeBits;
+        }
+
+        const Uint32* getTexels(int level) const {
+            return levels[level].texels.data();
+        }
+
+        // biggest copy stepping at most one texel a pixel, given how many full size texels a pixel steps
+        int levelFor(double texelsPerPixel) const {
+            int level = 0;
+            while (level + 1 < (int) levels.size() && texelsPerPixel > 1) {
+                texelsPerPixel /= 2;
+                level++;
+            }
+            return level;
+        }
+
+    private:
+        struct Level {
+            int sizeBits;
+            std::vector<Uint32> texels;  // row-major
+        };
+        std::vector<Level> levels;
+};
+
+// Loads each image once and keeps it as a MipTexture until the cache goes
+class TextureCache {
+    public:
+        // Requires relative path from project root. NULL if the image can't be loaded.
+        const MipTexture* get(const std::string& path) {
+            auto found = textures.find(path);
+            if (found != textures.end()) {
+                return found->second.get();
+            }
+            std::unique_ptr<MipTexture>& texture = textures[path];  // failures are cached too
+            SDL_Surface* loaded = IMG_Load(path.c_str());
+            if (loaded == NULL) {
+                std::cerr << "Unable to load texture: " << path << '\n' << SDL_GetError() << '\n';
+                return NULL;
+            }
+            SDL_Surface* converted = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_ARGB8888, 0);
+            SDL_FreeSurface(loaded);
+            if (converted == NULL) {
+                std::cerr << "Unable to convert texture: " << path << '\n' << SDL_GetError() << '\n';
+                return NULL;
+            }
+            SDL_LockSurface(converted);
+            texture.reset(new MipTexture((const Uint32*) converted->pixels, converted->w, converted->h, converted->pitch / sizeof(Uint32)));
+            SDL_UnlockSurface(converted);
+            SDL_FreeSurface(converted);
+            return texture.get();
+        }
+
+    private:
+        std::unordered_map<std::string, std::unique_ptr<MipTexture>> textures;
+};
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+// Worker threads kept for the life of the program that frames are split between.
+// forTiles cuts a range into tiles and deals each thread a run of neighbouring ones. A thread
+// works through its own run from the front, and once it's out steals the back half of another
+// thread's, so a thread whose tiles were cheap (facing a near wall) takes over from one whose
+// weren't (looking down a corridor) and none sit idle while there's work left.
+// The calling thread works through tiles too, so a pool of n threads starts n - 1 workers.
+// With one thread nothing is started and tiles run straight on the caller.
+class ThreadPool {
+    public:
+        // counters summed over every job since the last takeStats, for checking the threads
+        // stay busy. Times are totals over all threads.
+        struct Stats {
+            int jobs = 0;
+            int tiles = 0;
+            int steals = 0;  // successful steals, each takes half of what a thread had left
+            double busySeconds = 0;  // running tiles
+            double idleSeconds = 0;  // inside a job with nothing left to run or steal
+
+            double idleFraction() const {
+                double total = busySeconds + idleSeconds;
+                return (total > 0) ? idleSeconds / total : 0;
+            }
+        };
+
+        ThreadPool(int threadCount=0) {
+            this->threadCount = (threadCount > 0) ? threadCount : defaultThreadCount();
+        }
+
+        ~ThreadPool() {
+            stopWorkers();
+        }
+
+        // the pool rendering is shared out on, workers start on its first job
+        static ThreadPool& shared() {
+            static ThreadPool pool;
+            return pool;
+        }
+
+        static int defaultThreadCount() {
+            int cores = (int) std::thread::hardware_concurrency();
+            return (cores > 0) ? cores : 1;  // 0 when it can't be told
+        }
+
+        // takes effect on the next forTiles, 0 goes back to one per core
+        void setThreadCount(int count) {
+            if (count <= 0) {
+                count = defaultThreadCount();
+            }
+            if (count != threadCount) {
+                stopWorkers();
+                threadCount = count;
+            }
+        }
+
+        const int getThreadCount() const {
+            return threadCount;
+        }
+
+        // returns the counters and starts them again, once a frame
+        Stats takeStats() {
+            Stats taken = stats;
+            stats = Stats();
+            return taken;
+        }
+
+        // Calls tile(begin, end) over [0, count) in tiles tileSize long (the last may be shorter)
+        // and returns once every tile is done. tile must be safe to call from several threads
+        // at once. Only call from one thread at a time.
+        template <typename Tile>
+        void forTiles(int count, int tileSize, const Tile& tile) {
+            if (count <= 0) {
+                return;
+            }
+            auto start = std::chrono::steady_clock::now();
+            int tiles = (count + tileSize - 1) / tileSize;
+            stats.jobs++;
+            stats.tiles += tiles;
+            if (threadCount <= 1) {
+                tile(0, count);
+                stats.busySeconds += secondsSince(start);
+                return;
+            }
+            if (workers.empty()) {
+                startWorkers();
+            }
+
+            {
+                // a worker that woke too late for the last job may still be looking for tiles
+                std::unique_lock<std::mutex> lock(mutex);
+                finished.wait(lock, [this] { return busyWorkers == 0; });
+                job = [](const void* context, int begin, int end) {
+                    (*(const Tile*) context)(begin, end);
+                };
+                jobContext = &tile;
+                jobCount = count;
+                jobTileSize = tileSize;
+                tilesLeft = tiles;
+                // each thread starts with a run of neighbouring tiles
+                for (int i = 0; i < threadCount; i++) {
+                    slots[i].tiles.store(packRange((int64_t) tiles * i / threadCount, (int64_t) tiles * (i + 1) / threadCount));
+                    slots[i].busySeconds = 0;
+                    slots[i].steals = 0;
+                }
+                generation++;
+            }
+            wake.notify_all();
+
+            workTiles(0);
+            std::unique_lock<std::mutex> lock(mutex);
+            finished.wait(lock, [this] { return tilesLeft == 0 && busyWorkers == 0; });
+
+            // whatever each thread wasn't running tiles for, from the job starting to the last one finishing
+            double elapsed = secondsSince(start);
+            for (int i = 0; i < threadCount; i++) {
+                stats.busySeconds += slots[i].busySeconds;
+                stats.idleSeconds += std::max(elapsed - slots[i].busySeconds, 0.0);
+                stats.steals += slots[i].steals;
+            }
+        }
+
+    private:
+        // One per thread, the caller is slot 0. tiles is the thread's run of tiles still to do,
+        // begin in the top half and end in the bottom so the owner taking the front and thieves
+        // taking the back can both update it with one compare and swap.
+        struct alignas(64) Slot {
+            std::atomic<uint64_t> tiles{0};
+            double busySeconds = 0;
+            int steals = 0;
+        };
+
+        int threadCount;
+        std::vector<std::thread> workers;
+        std::unique_ptr<Slot[]> slots;
+        std::mutex mutex;
+        std::condition_variable wake;  // a new job or stopping
+        std::condition_variable finished;  // a worker ran out of tiles
+        bool stopping = false;
+        unsigned generation = 0;  // counts jobs so workers can tell a new one from a spurious wake
+        Stats stats;
+
+        // the current job, a plain function pointer so handing one out never allocates
+        void (*job)(const void* context, int begin, int end) = NULL;
+        const void* jobContext = NULL;
+        int jobCount = 0;
+        int jobTileSize = 0;
+        int tilesLeft = 0;  // guarded by mutex
+        int busyWorkers = 0;  // guarded by mutex, workers between picking up a job and running out of tiles
+
+        static uint64_t packRange(int64_t begin, int64_t end) {
+            return ((uint64_t) begin << 32) | (uint32_t) end;
+        }
+
+        static double secondsSince(std::chrono::steady_clock::time_point start) {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        void startWorkers() {
+            slots.reset(new Slot[threadCount]);
+            stopping = false;
+            unsigned current = generation;
+            for (int i = 1; i < threadCount; i++) {
+                workers.emplace_back([this, i, current] { workerLoop(i, current); });
+            }
+        }
+
+        void stopWorkers() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (std::thread& worker : workers) {
+                worker.join();
+            }
+            workers.clear();
+        }
+
+        // seen is the last job the pool ran before this worker started
+        void workerLoop(int slot, unsigned seen) {
+            while (true) {
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    wake.wait(lock, [&] { return stopping || generation != seen; });
+                    if (stopping) {
+                        return;
+                    }
+                    seen = generation;
+                    busyWorkers++;
+                }
+                workTiles(slot);
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    busyWorkers--;
+                }
+                finished.notify_one();
+            }
+        }
+
+        // runs the slot's own tiles then steals more, until a pass over every other slot finds none
+        void workTiles(int slot) {
+            Slot& own = slots[slot];
+            int done = 0;
+            while (true) {
+                int tile;
+                while (popFront(own, tile)) {
+                    auto start = std::chrono::steady_clock::now();
+                    int begin = tile * jobTileSize;
+                    job(jobContext, begin, std::min(begin + jobTileSize, jobCount));
+                    own.busySeconds += secondsSince(start);
+                    done++;
+                }
+                if (!steal(slot)) {
+                    break;
+                }
+            }
+            if (done > 0) {
+                std::lock_guard<std::mutex> lock(mutex);
+                tilesLeft -= done;
+            }
+        }
+
+        bool popFront(Slot& own, int& tile) {
+            uint64_t range = own.tiles.load();
+            while (true) {
+                int begin = (int) (range >> 32);
+                int end = (int) (uint32_t) range;
+                if (begin >= end) {
+                    return false;
+                }
+                if (own.tiles.compare_exchange_weak(range, packRange(begin + 1, end))) {
+                    tile = begin;
+                    return true;
+                }
+            }
+        }
+
+        // moves the back half of the first other slot with tiles left into this one, which is empty
+        bool steal(int slot) {
+            for (int i = 1; i < threadCount; i++) {
+                Slot& victim = slots[(slot + i) % threadCount];
+                uint64_t range = victim.tiles.load();
+                while (true) {
+                    int begin = (int) (range >> 32);
+                    int end = (int) (uint32_t) range;
+                    if (begin >= end) {
+                        break;
+                    }
+                    int split = end - (end - begin + 1) / 2;
+                    if (victim.tiles.compare_exchange_weak(range, packRange(begin, split))) {
+                        slots[slot].tiles.store(packRange(split, end));
+                        slots[slot].steals++;
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+};
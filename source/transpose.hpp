@@ -0,0 +1,206 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TRANSPOSE_X86
+#include <immintrin.h>
+#endif
+
+// Ways of turning a column-major image into a row-major one
+enum TransposeMode {
+    naiveTranspose,  // pixel by pixel in destination order
+    blockedTranspose,  // pixel by pixel a tile at a time
+    sse2Transpose,  // tiles moved 4x4 pixels at a time in registers
+    avx2Transpose  // tiles moved 8x8 pixels at a time in registers
+};
+
+// Copies a column-major image into a row-major one for upload (Window::presentRender).
+// Reading columns and writing rows can't both be sequential, so the image is walked in
+// tiles small enough that the rows and columns they touch stay in cache. Inside a tile,
+// square blocks are transposed in SIMD registers when the CPU has them.
+// The avx2 blocks measured slower than sse2 on the machines tried (the halves have to be
+// swapped across the register) so sse2 is the default and avx2 has to be asked for.
+class Transpose {
+    public:
+        static const TransposeMode getMode() {
+            if (!modeChosen) {
+                setMode(TransposeMode::sse2Transpose);
+            }
+            return mode;
+        }
+
+        // requested mode is lowered to the best the CPU supports
+        static void setMode(TransposeMode requested) {
+            TransposeMode supported = getSupportedMode();
+            mode = (requested > supported) ? supported : requested;
+            modeChosen = true;
+        }
+
+        static const char* getModeName(TransposeMode transposeMode) {
+            if (transposeMode == TransposeMode::avx2Transpose) {
+                return "avx2";
+            } else if (transposeMode == TransposeMode::sse2Transpose) {
+                return "sse2";
+            } else if (transposeMode == TransposeMode::blockedTranspose) {
+                return "blocked";
+            }
+            return "naive";
+        }
+
+        static const TransposeMode getSupportedMode() {
+#ifdef TRANSPOSE_X86
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2")) {
+                return TransposeMode::avx2Transpose;
+            }
+            return TransposeMode::sse2Transpose;  // always there on x86-64
+#endif
+            return TransposeMode::blockedTranspose;
+        }
+
+        // source holds width columns of height pixels, destination gets height rows of width pixels.
+        // Only columns [startX, endX) are copied when given, so the image can be split between
+        // threads. Starting each part on a multiple of tileSize keeps the blocks where they'd be
+        // for the whole image. Call getMode before splitting, it picks the mode the first time.
+        static void columnsToRows(const uint32_t* source, uint32_t* destination, int width, int height, int startX=0, int endX=-1) {
+            if (endX < 0) {
+                endX = width;
+            }
+            TransposeMode transposeMode = getMode();
+            if (transposeMode == TransposeMode::naiveTranspose) {
+                for (int y = 0; y < height; y++) {
+                    for (int x = startX; x < endX; x++) {
+                        destination[y * width + x] = source[x * height + y];
+                    }
+                }
+                return;
+            }
+
+            // whole blocks a tile at a time, then the strips along the right and bottom edges
+            // that don't fill a block
+            int block = 1;
+            if (transposeMode == TransposeMode::avx2Transpose) {
+                block = 8;
+            } else if (transposeMode == TransposeMode::sse2Transpose) {
+                block = 4;
+            }
+            int blockWidth = width / block * block;
+            int blockHeight = height / block * block;
+            int blockEndX = std::min(endX, blockWidth);
+            if (transposeMode == TransposeMode::avx2Transpose) {
+                blocksAVX2(source, destination, width, height, startX, blockEndX);
+            } else if (transposeMode == TransposeMode::sse2Transpose) {
+                blocksSSE2(source, destination, width, height, startX, blockEndX);
+            } else {
+                blocksScalar(source, destination, width, height, startX, blockEndX);
+            }
+            copyScalar(source, destination, width, height, std::max(startX, blockWidth), endX, 0, height);
+            copyScalar(source, destination, width, height, startX, blockEndX, blockHeight, height);
+        }
+
+        static inline const int tileSize = 64;  // 64 columns and rows of 64 pixels is 32KB, about L1
+
+    private:
+        static inline TransposeMode mode = TransposeMode::naiveTranspose;
+        static inline bool modeChosen = false;
+
+        // destination rows [startY, endY) of columns [startX, endX)
+        static void copyScalar(const uint32_t* source, uint32_t* destination, int width, int height,
+                               int startX, int endX, int startY, int endY) {
+            for (int x = startX; x < endX; x++) {
+                for (int y = startY; y < endY; y++) {
+                    destination[y * width + x] = source[x * height + y];
+                }
+            }
+        }
+
+        // blocks of columns [startX, endX)
+        static void blocksScalar(const uint32_t* source, uint32_t* destination, int width, int height, int startX, int endX) {
+            for (int tileX = startX; tileX < endX; tileX += tileSize) {
+                for (int tileY = 0; tileY < height; tileY += tileSize) {
+                    copyScalar(source, destination, width, height, tileX, std::min(tileX + tileSize, endX), tileY, std::min(tileY + tileSize, height));
+                }
+            }
+        }
+
+#ifdef TRANSPOSE_X86
+        // rows a to d of 4 pixels become columns
+        static inline void transpose4x4(const uint32_t* source, int sourceStride, uint32_t* destination, int destinationStride) {
+            __m128i a = _mm_loadu_si128((const __m128i*) (source));
+            __m128i b = _mm_loadu_si128((const __m128i*) (source + sourceStride));
+            __m128i c = _mm_loadu_si128((const __m128i*) (source + 2 * sourceStride));
+            __m128i d = _mm_loadu_si128((const __m128i*) (source + 3 * sourceStride));
+            __m128i ab01 = _mm_unpacklo_epi32(a, b);  // a0 b0 a1 b1
+            __m128i cd01 = _mm_unpacklo_epi32(c, d);
+            __m128i ab23 = _mm_unpackhi_epi32(a, b);  // a2 b2 a3 b3
+            __m128i cd23 = _mm_unpackhi_epi32(c, d);
+            _mm_storeu_si128((__m128i*) (destination), _mm_unpacklo_epi64(ab01, cd01));  // a0 b0 c0 d0
+            _mm_storeu_si128((__m128i*) (destination + destinationStride), _mm_unpackhi_epi64(ab01, cd01));
+            _mm_storeu_si128((__m128i*) (destination + 2 * destinationStride), _mm_unpacklo_epi64(ab23, cd23));
+            _mm_storeu_si128((__m128i*) (destination + 3 * destinationStride), _mm_unpackhi_epi64(ab23, cd23));
+        }
+
+        // same as transpose4x4 within each 128 bit half, then the halves are swapped over
+        __attribute__((target("avx2")))
+        static inline void transpose8x8(const uint32_t* source, int sourceStride, uint32_t* destination, int destinationStride) {
+            __m256i row[8];
+            for (int i = 0; i < 8; i++) {
+                row[i] = _mm256_loadu_si256((const __m256i*) (source + i * sourceStride));
+            }
+            __m256i pairs[8];
+            for (int i = 0; i < 8; i += 2) {
+                pairs[i] = _mm256_unpacklo_epi32(row[i], row[i + 1]);  // a0 b0 a1 b1 | a4 b4 a5 b5
+                pairs[i + 1] = _mm256_unpackhi_epi32(row[i], row[i + 1]);  // a2 b2 a3 b3 | a6 b6 a7 b7
+            }
+            __m256i quads[8];
+            for (int i = 0; i < 8; i += 4) {
+                quads[i] = _mm256_unpacklo_epi64(pairs[i], pairs[i + 2]);  // a0 b0 c0 d0 | a4 b4 c4 d4
+                quads[i + 1] = _mm256_unpackhi_epi64(pairs[i], pairs[i + 2]);  // a1 .. | a5 ..
+                quads[i + 2] = _mm256_unpacklo_epi64(pairs[i + 1], pairs[i + 3]);  // a2 .. | a6 ..
+                quads[i + 3] = _mm256_unpackhi_epi64(pairs[i + 1], pairs[i + 3]);  // a3 .. | a7 ..
+            }
+            for (int i = 0; i < 4; i++) {
+                _mm256_storeu_si256((__m256i*) (destination + i * destinationStride), _mm256_permute2x128_si256(quads[i], quads[i + 4], 0x20));
+                _mm256_storeu_si256((__m256i*) (destination + (i + 4) * destinationStride), _mm256_permute2x128_si256(quads[i], quads[i + 4], 0x31));
+            }
+        }
+
+        // The tile loops are repeated for each instruction set so the block transposes inline
+        // into them, a function built for avx2 can't be inlined into one that isn't
+        static void blocksSSE2(const uint32_t* source, uint32_t* destination, int width, int height, int startX, int endX) {
+            int blockHeight = height / 4 * 4;
+            for (int tileX = startX; tileX < endX; tileX += tileSize) {
+                for (int tileY = 0; tileY < blockHeight; tileY += tileSize) {
+                    int tileEndX = std::min(tileX + tileSize, endX);
+                    int endY = std::min(tileY + tileSize, blockHeight);
+                    for (int x = tileX; x < tileEndX; x += 4) {
+                        for (int y = tileY; y < endY; y += 4) {
+                            transpose4x4(source + x * height + y, height, destination + y * width + x, width);
+                        }
+                    }
+                }
+            }
+        }
+
+        __attribute__((target("avx2")))
+        static void blocksAVX2(const uint32_t* source, uint32_t* destination, int width, int height, int startX, int endX) {
+            int blockHeight = height / 8 * 8;
+            for (int tileX = startX; tileX < endX; tileX += tileSize) {
+                for (int tileY = 0; tileY < blockHeight; tileY += tileSize) {
+                    int tileEndX = std::min(tileX + tileSize, endX);
+                    int endY = std::min(tileY + tileSize, blockHeight);
+                    for (int x = tileX; x < tileEndX; x += 8) {
+                        for (int y = tileY; y < endY; y += 8) {
+                            transpose8x8(source + x * height + y, height, destination + y * width + x, width);
+                        }
+                    }
+                }
+            }
+        }
+#else
+        static void blocksSSE2(const uint32_t* source, uint32_t* destination, int width, int height, int startX, int endX) {}
+        static void blocksAVX2(const uint32_t* source, uint32_t* destination, int width, int height, int startX, int endX) {}
+#endif
+};
@@ -3,9 +3,12 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <algorithm>
 #include "../include/SDL2/SDL.h"
 #include "../include/SDL2/SDL_image.h"
 #include "point.hpp"
+#include "transpose.hpp"
+#include "threadpool.hpp"
 
 class Colour {
     public:
@@ -47,6 +50,12 @@ enum RenderMode {
     hardwareRendering,  // uses textures and window renderer to render with the GPU.
 };
 
+// Order pixels are stored in while a frame is drawn
+enum PixelLayout {
+    rowMajor,  // drawn straight into the upload buffer
+    columnMajor  // columns are contiguous, transposed into the upload buffer on present
+};
+
 class Window {
     public:
         static inline const int screenWidth = 800;
@@ -171,9 +180,29 @@ class Window {
 
 // MARK: -- RENDERING ----------------------------------------------------------------
 
+        // Only the part of the pixel buffer drawn into since the last clear is reset, so modes
+        // that draw with the renderer pay nothing for it. 3D covers every pixel each frame with
+        // fillColumnBands and doesn't need to call this.
         void clear() {
-            for (int i = 0; i < screenHeight * screenWidth; i++) {
-                pixels[i] = Colours::black.ARGB8888();
+            if (dirtyLeft < dirtyRight) {
+                // tiles of whole rows or columns, whichever are contiguous
+                if (pixelLayout == PixelLayout::columnMajor) {
+                    ThreadPool::shared().forTiles(dirtyRight - dirtyLeft, clearTileSize, [&](int begin, int end) {
+                        for (int x = dirtyLeft + begin; x < dirtyLeft + end; x++) {
+                            std::fill(pixelAt(x, dirtyTop), pixelAt(x, dirtyBottom - 1) + 1, background);
+                        }
+                    });
+                } else {
+                    ThreadPool::shared().forTiles(dirtyBottom - dirtyTop, clearTileSize, [&](int begin, int end) {
+                        for (int y = dirtyTop + begin; y < dirtyTop + end; y++) {
+                            std::fill(pixelAt(dirtyLeft, y), pixelAt(dirtyRight - 1, y) + 1, background);
+                        }
+                    });
+                }
+                dirtyLeft = screenWidth;
+                dirtyRight = 0;
+                dirtyTop = screenHeight;
+                dirtyBottom = 0;
             }
             SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
             SDL_RenderClear(renderer);
@@ -263,8 +292,9 @@ class Window {
         // - pixel buffer -
 
         void renderPixel(int x, int y, Colour colour) {
-            if (x < screenWidth && y < screenHeight && x >= 0 && y >= 0) {
-                pixels[y * screenWidth + x] = colour.ARGB8888();
+            if (x < renderWidth && y < renderHeight && x >= 0 && y >= 0) {
+                markDirty(x, y, y + 1);
+                *pixelAt(x, y) = colour.ARGB8888();
             }
         }
 
@@ -272,6 +302,203 @@ class Window {
             renderPixel(pixel.x(), pixel.y(), colour);
         }
 
+        // mixes colour over what is already there by its alpha, for see-through surfaces
+        void blendPixel(int x, int y, Colour colour) {
+            if (x < renderWidth && y < renderHeight && x >= 0 && y >= 0) {
+                markDirty(x, y, y + 1);
+                Uint32* pixel = pixelAt(x, y);
+                Uint32 under = *pixel;
+                int r = (under >> 16) & 0xFF;
+                int g = (under >> 8) & 0xFF;
+                int b = under & 0xFF;
+                r += (colour.r - r) * colour.a / 255;
+                g += (colour.g - g) * colour.a / 255;
+                b += (colour.b - b) * colour.a / 255;
+                *pixel = 0xFF000000 | (Uint32) ((r << 16) + (g << 8) + b);
+            }
+        }
+
+        // - spans -
+        // Write a run of pixels down one column, clipping once per span rather than per pixel.
+        // yEnd is exclusive.
+
+        void fillColumn(int x, int yStart, int yEnd, Uint32 colour) {
+            if (!clipColumn(x, yStart, yEnd)) {
+                return;
+            }
+            Uint32* pixel = pixelAt(x, yStart);
+            int step = columnStep();
+            for (int y = yStart; y < yEnd; y++) {
+                *pixel = colour;
+                pixel += step;
+            }
+        }
+
+        // Writes a whole column in one pass, ceiling down to wallStart, the wall to wallEnd, then
+        // floor to the bottom. Every pixel is written once so the frame needs no clear before it.
+        void fillColumnBands(int x, int wallStart, int wallEnd, Uint32 ceiling, Uint32 wall, Uint32 floor) {
+            int yStart = 0;
+            int yEnd = renderHeight;
+            if (!clipColumn(x, yStart, yEnd)) {
+                return;
+            }
+            wallStart = std::clamp(wallStart, 0, renderHeight);
+            wallEnd = std::clamp(wallEnd, wallStart, renderHeight);
+            Uint32* pixel = pixelAt(x, 0);
+            int step = columnStep();
+            int y = 0;
+            for (; y < wallStart; y++) {
+                *pixel = ceiling;
+                pixel += step;
+            }
+            for (; y < wallEnd; y++) {
+                *pixel = wall;
+                pixel += step;
+            }
+            for (; y < renderHeight; y++) {
+                *pixel = floor;
+                pixel += step;
+            }
+        }
+
+        // Copies texels down a column, v is the 16.16 texel position of yStart and advances by
+        // vStep a pixel. texels must reach past the last v, rounding vStep down keeps it inside
+        // a column of the same height. Texels are scaled by shade / 256 when it's below 256.
+        void fillColumnTextured(int x, int yStart, int yEnd, const Uint32* texels, Sint32 v, Sint32 vStep, int shade=256) {
+            int unclipped = yStart;
+            if (!clipColumn(x, yStart, yEnd)) {
+                return;
+            }
+            v += (yStart - unclipped) * vStep;  // skip texels above the top of the screen
+            Uint32* pixel = pixelAt(x, yStart);
+            int step = columnStep();
+            if (shade >= 256) {
+                for (int y = yStart; y < yEnd; y++) {
+                    *pixel = texels[v >> 16];
+                    pixel += step;
+                    v += vStep;
+                }
+                return;
+            }
+            Uint32 scale = (Uint32) std::max(shade, 0);
+            for (int y = yStart; y < yEnd; y++) {
+                *pixel = shadeTexel(texels[v >> 16], scale);
+                pixel += step;
+                v += vStep;
+            }
+        }
+
+        // fillColumnTextured for images with holes in, texels with no alpha are skipped
+        void fillColumnMasked(int x, int yStart, int yEnd, const Uint32* texels, Sint32 v, Sint32 vStep, int shade=256) {
+            int unclipped = yStart;
+            if (!clipColumn(x, yStart, yEnd)) {
+                return;
+            }
+            v += (yStart - unclipped) * vStep;
+            Uint32* pixel = pixelAt(x, yStart);
+            int step = columnStep();
+            Uint32 scale = (Uint32) std::clamp(shade, 0, 256);
+            for (int y = yStart; y < yEnd; y++) {
+                Uint32 texel = texels[v >> 16];
+                if (texel & 0xFF000000) {
+                    *pixel = shadeTexel(texel, scale);
+                }
+                pixel += step;
+                v += vStep;
+            }
+        }
+
+        // texel scaled by scale / 256, scale at most 256
+        static Uint32 shadeTexel(Uint32 texel, Uint32 scale) {
+            // red and blue scaled together, the gap between them takes the overflow
+            Uint32 redBlue = (((texel & 0xFF00FF) * scale) >> 8) & 0xFF00FF;
+            Uint32 green = (((texel & 0x00FF00) * scale) >> 8) & 0x00FF00;
+            return 0xFF000000 | redBlue | green;
+        }
+
+        // blendPixel down a column
+        void blendColumn(int x, int yStart, int yEnd, Colour colour) {
+            if (!clipColumn(x, yStart, yEnd)) {
+                return;
+            }
+            Uint32* pixel = pixelAt(x, yStart);
+            int step = columnStep();
+            for (int y = yStart; y < yEnd; y++) {
+                Uint32 under = *pixel;
+                int r = (under >> 16) & 0xFF;
+                int g = (under >> 8) & 0xFF;
+                int b = under & 0xFF;
+                r += (colour.r - r) * colour.a / 255;
+                g += (colour.g - g) * colour.a / 255;
+                b += (colour.b - b) * colour.a / 255;
+                *pixel = 0xFF000000 | (Uint32) ((r << 16) + (g << 8) + b);
+                pixel += step;
+            }
+        }
+
+        // - scanlines -
+        // For code that draws whole rows itself: the first pixel of row y and the distance from a
+        // pixel to the one on its right, only 1 when row-major. Nothing is clipped or marked dirty.
+
+        Uint32* rowStart(int y) {
+            return pixelAt(0, y);
+        }
+
+        int rowStep() const {
+            return (pixelLayout == PixelLayout::columnMajor) ? renderHeight : 1;
+        }
+
+        // Grows the rectangle clear() resets to cover [xStart, xEnd) x [yStart, yEnd). Spans mark
+        // what they draw themselves, but only write when it grows, so threads drawing inside an
+        // area marked beforehand don't race on it.
+        void markDirty(int xStart, int xEnd, int yStart, int yEnd) {
+            if (xStart < dirtyLeft) { dirtyLeft = xStart; }
+            if (xEnd > dirtyRight) { dirtyRight = xEnd; }
+            if (yStart < dirtyTop) { dirtyTop = yStart; }
+            if (yEnd > dirtyBottom) { dirtyBottom = yEnd; }
+        }
+
+        // Column-major keeps each column's pixels together, so the column spans above write
+        // sequentially. Switching clears the frame.
+        void setPixelLayout(PixelLayout layout) {
+            pixelLayout = layout;
+            if (layout == PixelLayout::columnMajor) {
+                columnPixels.resize(screenWidth * screenHeight);
+            }
+            markDirty(0, renderWidth, 0, renderHeight);  // the other buffer has whatever was last drawn in it
+            clear();
+        }
+
+        const PixelLayout getPixelLayout() const {
+            return pixelLayout;
+        }
+
+        // Size of the pixel buffer frames are drawn into, at most the window's. presentRender
+        // scales it up to fill the window, so drawing fewer pixels trades sharpness for time.
+        // Rows (or columns when column-major) are packed at the new size, so changing it clears the frame.
+        void setRenderSize(int width, int height) {
+            width = std::clamp(width, 1, screenWidth);
+            height = std::clamp(height, 1, screenHeight);
+            if (width == renderWidth && height == renderHeight) {
+                return;
+            }
+            renderWidth = width;
+            renderHeight = height;
+            dirtyLeft = 0;
+            dirtyRight = renderWidth;
+            dirtyTop = 0;
+            dirtyBottom = renderHeight;
+            clear();
+        }
+
+        const int getRenderWidth() const {
+            return renderWidth;
+        }
+
+        const int getRenderHeight() const {
+            return renderHeight;
+        }
+
         // -- General --
 
         void setTitle(std::string title) {
@@ -282,9 +509,19 @@ class Window {
         void presentRender() {
             // render by renderer
             if (renderMode == RenderMode::simpleRenderer || renderMode == RenderMode::hardwareRendering) {
-                if (renderMode == RenderMode::hardwareRendering) {
-                    SDL_UpdateTexture(screenTexture, NULL, pixels, screenWidth * sizeof(Uint32));
-                    renderTextureFillScreen(screenTexture);
+                // nothing to upload if the pixel buffer is still clear, which also stops it
+                // covering anything drawn with the renderer
+                if (renderMode == RenderMode::hardwareRendering && dirtyLeft < dirtyRight) {
+                    if (pixelLayout == PixelLayout::columnMajor) {
+                        Transpose::getMode();
+                        ThreadPool::shared().forTiles(renderWidth, Transpose::tileSize, [&](int begin, int end) {
+                            Transpose::columnsToRows(columnPixels.data(), pixels, renderWidth, renderHeight, begin, end);
+                        });
+                    }
+                    // only the corner of the texture the render size covers, stretched over the window
+                    SDL_Rect area = {0, 0, renderWidth, renderHeight};
+                    SDL_UpdateTexture(screenTexture, &area, pixels, renderWidth * sizeof(Uint32));
+                    SDL_RenderCopy(renderer, screenTexture, &area, NULL);
                 }
                 SDL_RenderPresent(renderer);
             // render by window surface
@@ -295,12 +532,53 @@ class Window {
         }
 
     private:
+        Uint32* pixelAt(int x, int y) {
+            return (pixelLayout == PixelLayout::columnMajor) ? &columnPixels[x * renderHeight + y] : &pixels[y * renderWidth + x];
+        }
+
+        // distance between a pixel and the one below it
+        int columnStep() const {
+            return (pixelLayout == PixelLayout::columnMajor) ? 1 : renderWidth;
+        }
+
+        // trims a span to the screen, false if none of it is left. Spans that are left are
+        // about to be drawn so are marked dirty.
+        bool clipColumn(int x, int& yStart, int& yEnd) {
+            if (x < 0 || x >= renderWidth) {
+                return false;
+            }
+            yStart = std::max(yStart, 0);
+            yEnd = std::min(yEnd, renderHeight);
+            if (yStart >= yEnd) {
+                return false;
+            }
+            markDirty(x, yStart, yEnd);
+            return true;
+        }
+
+        // grows the dirty rectangle to cover rows [yStart, yEnd) of column x
+        void markDirty(int x, int yStart, int yEnd) {
+            markDirty(x, x + 1, yStart, yEnd);
+        }
+
         RenderMode renderMode;
         SDL_Window* window = NULL;
         SDL_Renderer* renderer = NULL;
         SDL_Surface* screenSurface = NULL;
         SDL_Texture * screenTexture = NULL;  // used for per pixel modification and rendering
         Uint32 pixels[screenHeight * screenWidth];  // pixel buffer that is then used to update texture
+        PixelLayout pixelLayout = PixelLayout::rowMajor;
+        int renderWidth = screenWidth;
+        int renderHeight = screenHeight;
+        std::vector<Uint32> columnPixels;  // drawn into instead of pixels when column-major
+        const Uint32 background = Colours::black.ARGB8888();
+        static inline const int clearTileSize = 32;  // rows or columns cleared per tile
+        // part of the pixel buffer drawn since the last clear, starts as everything so the
+        // first clear covers the whole buffer
+        int dirtyLeft = 0;
+        int dirtyRight = screenWidth;
+        int dirtyTop = 0;
+        int dirtyBottom = screenHeight;
         std::vector<SDL_Texture*> allocatedTextures = {screenTexture};  // vector of textures for deallocation on close
         std::vector<SDL_Surface*> allocatedSurfaces = {screenSurface};  // vector of surface for deallocation on close
 };
\ No newline at end of file